@@ -1,13 +1,17 @@
 import os
+import zlib
 import pandas as pd
 import numpy as np
 import matplotlib.pyplot as plt
-import scipy.optimize as opt
+from lifetime_fit import fit_tau_profiled # shared with check_lifetime_fit.py
 
 RUNINFO_CSV = 'runinfo_2022_all.csv'
 ANALYSIS_DIR = './output/results/'
 GRAPH_DIR = './output/graphs/'
+SUMMARY_DIR = './output/summary/'
+USE_PE_SUMMARY = True # count thresholds from PESummary cubes when a run has one
 GOOD_RUNS_TXT = './config/2022runlist.txt'
+RESULT_STORE = '' # campaign store from "result_store" in the C++ config ('' = per-run files)
 
 SEGMENTS = ['12', '34', '56', '78']
 
@@ -38,61 +42,172 @@ def load_good_runs(path):
 GOOD_RUNS = load_good_runs(GOOD_RUNS_TXT)
 
 # -----------------------------
-# Lifetime fitting (profile A)
+# PulseAnalysis result loading
 # -----------------------------
-def fit_tau_profiled(counts_raw, ts):
+# binary columnar layout written by Pulse_Output.cpp (see include/Pulse_Output.h)
+PCOL_HEADER = np.dtype([('magic', 'S8'), ('version', '<u4'), ('flags', '<u4'), ('run', '<i4'),
+                        ('n_columns', '<u4'), ('n_groups', '<u4'), ('reserved', '<u4'),
+                        ('n_rows', '<u8'), ('group_dir', '<u8'), ('column_dir', '<u8'), ('chunk_dir', '<u8')])
+PCOL_GROUP = np.dtype([('segment', 'S8'), ('event', '<u4'), ('reserved', '<u4'),
+                       ('first_row', '<u8'), ('n_rows', '<u8')])
+PCOL_COLUMN = np.dtype([('name', 'S24'), ('dtype', 'S8')])
+PCOL_CHUNK = np.dtype([('offset', '<u8'), ('stored', '<u8'), ('raw', '<u8')])
+
+def read_pulse_binary(buf):
     """
-    Fit tau for y_i vs t_i with model A * exp(-t_i/tau),
-    profiling A analytically for each tau.
+    Decode a PulseAnalysis binary buffer (bytes or np.memmap).
+    Uncompressed columns are zero-copy views into 'buf'.
 
-    counts_raw: array-like of background-corrected, normalized counts (>=0 preferred)
-    ts:         array-like of hold times (seconds)
-    Returns (tau, dtau)
+    Returns dict: column name -> array, plus per-row 'segment' (int) and 'event' (1 = signal)
     """
-    counts = np.asarray(counts_raw, dtype=float) # y_i (background-corrected, normalized)
-    ts = np.asarray(ts, dtype=float)
-    errors = np.sqrt(np.maximum(counts, 1e-9)) # heuristic σ_i after normalization 
-
-    w = 1.0 / (errors**2)
-
-    def chi2_for_tau(tau):
-        if tau <= 0:
-            return np.inf, np.nan
-        m = np.exp(-ts / tau) # model basis for given τ
-        num = np.sum(w * counts * m)
-        den = np.sum(w * m * m)
-        if den <= 0:
-            return np.inf, np.nan
-        Ahat = num / den # profile amplitude analytically
-        chi2 = np.sum(w * (counts - Ahat*m)**2) # χ²(τ) with A=Ahat(τ)
-        return chi2, Ahat
-
-    res = opt.minimize(lambda x: chi2_for_tau(x[0])[0],
-                       x0=np.array([800.0]), method='Powell',
-                       bounds = [(1.0, 1e6)])
-    tau_best = float(res.x[0])
-    chi2_min, _ = chi2_for_tau(tau_best)
-    
-    # Scan around best to get Δχ²=1 band
-    span = max(50.0, 0.15 * tau_best) # scan window around τ*
-    taus = np.linspace(max(1.0, tau_best - span), tau_best + span, 2001)
-    chi2_vals = np.array([chi2_for_tau(tau)[0] for tau in taus])
-    ok = chi2_vals < (np.nanmin(chi2_vals) + 1.0) # Δχ²=1 condition
-    if not np.any(ok):
-        return tau_best, np.nan
+    h = np.frombuffer(buf, PCOL_HEADER, count=1, offset=0)[0]
+    if h['magic'] != b'UCNPCOL1' or h['version'] != 1:
+        raise ValueError('not a PulseAnalysis binary file')
+    n_groups, n_cols, n_rows = int(h['n_groups']), int(h['n_columns']), int(h['n_rows'])
+    groups = np.frombuffer(buf, PCOL_GROUP, count=n_groups, offset=int(h['group_dir']))
+    columns = np.frombuffer(buf, PCOL_COLUMN, count=n_cols, offset=int(h['column_dir']))
+    chunks = np.frombuffer(buf, PCOL_CHUNK, count=n_cols * n_groups,
+                           offset=int(h['chunk_dir'])).reshape(n_cols, n_groups)
+    compressed = bool(h['flags'] & 1)
+
+    out = {}
+    for c, col in enumerate(columns):
+        name = col['name'].decode()
+        dt = np.dtype(col['dtype'].decode())
+        if n_rows == 0:
+            out[name] = np.empty(0, dtype=dt)
+        elif not compressed:
+            # chunks of one column are back to back: a single view covers all row groups
+            out[name] = np.frombuffer(buf, dt, count=n_rows, offset=int(chunks[c, 0]['offset']))
+        else:
+            parts = [zlib.decompress(bytes(buf[int(k['offset']):int(k['offset']) + int(k['stored'])]))
+                     for k in chunks[c] if k['raw'] > 0]
+            out[name] = np.frombuffer(b''.join(parts), dt)
+
+    sizes = groups['n_rows'].astype(np.int64)
+    out['segment'] = np.repeat([int(g['segment'].decode()) for g in groups], sizes)
+    out['event'] = np.repeat(groups['event'].astype(np.int64), sizes)
+    return out
+
+# consolidated result store (see include/Result_Store.h)
+STORE_RECORD = np.dtype([('magic', '<u4'), ('kind', '<u4'), ('run', '<i4'), ('crc', '<u4'),
+                         ('payload', '<u8'), ('reserved', '<u8')])
+STORE_TRAILER = np.dtype([('magic', '<u4'), ('kind', '<u4'), ('run', '<i4'), ('crc', '<u4'),
+                          ('record', '<u8'), ('prev', '<u8')])
+STORE_KIND_PULSES = 1
+STORE_KIND_TAIL = 2
+STORE_KIND_SUMMARY = 3
+
+def open_result_store(path):
+    """
+    Memory-map a result store and index its committed records.
+    Returns (mm, index) with index[(kind, run)] = (payload offset, payload bytes); newest commit wins.
+    """
+    mm = np.memmap(path, dtype=np.uint8, mode='r')
+    if bytes(mm[:8]) != b'UCNSTOR1':
+        raise ValueError(f'{path} is not a result store')
+
+    def commit_at(pos):
+        if pos < 64 or pos + 32 > len(mm):
+            return None
+        t = np.frombuffer(mm, STORE_TRAILER, count=1, offset=pos)[0]
+        if t['magic'] != 0x31544d43 or t['record'] < 32 or t['record'] + 32 > pos:
+            return None
+        r = np.frombuffer(mm, STORE_RECORD, count=1, offset=int(t['record']))[0]
+        ok = (r['magic'] == 0x31434552 and r['kind'] == t['kind'] and r['run'] == t['run']
+              and r['crc'] == t['crc'] and int(t['record']) + 32 + int(r['payload']) == pos)
+        return t if ok else None
+
+    tail = len(mm) - 32
+    if commit_at(tail) is None:
+        # torn tail from an interrupted writer: walk records forward to the last full commit
+        tail, off = 0, 32
+        while off + 32 <= len(mm):
+            r = np.frombuffer(mm, STORE_RECORD, count=1, offset=off)[0]
+            if r['magic'] != 0x31434552 or commit_at(off + 32 + int(r['payload'])) is None:
+                break
+            tail = off + 32 + int(r['payload'])
+            off = tail + 32
+
+    index = {}
+    pos = tail
+    while pos:
+        t = commit_at(pos)
+        if t is None:
+            break
+        start = int(t['record']) + 32
+        index.setdefault((int(t['kind']), int(t['run'])), (start, pos - start))
+        pos = int(t['prev'])
+    return mm, index
+
+_STORE = open_result_store(RESULT_STORE) if RESULT_STORE and os.path.exists(RESULT_STORE) else None
+
+def pulse_columns_to_df(cols):
+    return pd.DataFrame({'Segment': cols['segment'],
+                         'Time (us)': cols['time_us'] / 1e6, # same units as the CSV column
+                         'PE': cols['pe'],
+                         'Event': cols['event']})
+
+def load_pulse_results(run):
+    """PulseAnalysis results for a run as a DataFrame (CSV layout): store, then binary, then CSV."""
+    if _STORE is not None:
+        mm, index = _STORE
+        rec = index.get((STORE_KIND_PULSES, int(run)))
+        if rec is not None:
+            return pulse_columns_to_df(read_pulse_binary(mm[rec[0]:rec[0] + rec[1]]))
+
+    fbin = os.path.join(ANALYSIS_DIR, f'PulseAnalysis_{run}.bin')
+    if os.path.exists(fbin):
+        return pulse_columns_to_df(read_pulse_binary(np.memmap(fbin, dtype=np.uint8, mode='r')))
+
+    f = os.path.join(ANALYSIS_DIR, f'PulseAnalysis_{run}.csv')
+    if not os.path.exists(f):
+        return None
+    df = pd.read_csv(f)
+    df.columns = df.columns.str.strip()
+    return df
 
-    left_idx  = np.argmax(ok)
-    right_idx = len(ok) - np.argmax(ok[::-1]) - 1
-    tau_left, tau_right = taus[left_idx], taus[right_idx]
-    dtau = 0.5 * (tau_right - tau_left)
+# per-run threshold cubes written by PE_Summary.cpp (see include/PE_Summary.h)
+PESM_HEADER = np.dtype([('magic', 'S8'), ('run', '<i4'), ('n_segments', '<u4'), ('bins_per_pe', '<u4'),
+                        ('n_bins', '<u4'), ('raw', '<u8'), ('stored', '<u8')])
 
-    return tau_best, dtau
+def read_pe_summary(buf):
+    """
+    Decode a PESummary buffer.
+    Returns (bins_per_pe, {segment: cube}); cube[event, k] = #pulses with PE > k / bins_per_pe,
+    event 0 = background, 1 = signal.
+    """
+    buf = bytes(buf)
+    h = np.frombuffer(buf, PESM_HEADER, count=1)[0]
+    if h['magic'] != b'UCNPESM1':
+        raise ValueError('not a PE summary')
+    n_seg, n_bins = int(h['n_segments']), int(h['n_bins'])
+    off = PESM_HEADER.itemsize
+    labels = [int(buf[off + 8*i: off + 8*(i+1)].rstrip(b'\0')) for i in range(n_seg)]
+    off += 8 * n_seg
+    cube = np.frombuffer(zlib.decompress(buf[off:off + int(h['stored'])]), '<u4').reshape(n_seg, 2, n_bins)
+    return int(h['bins_per_pe']), {seg: cube[i] for i, seg in enumerate(labels)}
+
+def load_pe_summary(run):
+    """PESummary cube for a run from the store or SUMMARY_DIR; None if the run has none."""
+    if _STORE is not None:
+        mm, index = _STORE
+        rec = index.get((STORE_KIND_SUMMARY, int(run)))
+        if rec is not None:
+            return read_pe_summary(mm[rec[0]:rec[0] + rec[1]])
+    f = os.path.join(SUMMARY_DIR, f'PESummary_{run}.bin')
+    if not os.path.exists(f):
+        return None
+    with open(f, 'rb') as fh:
+        return read_pe_summary(fh.read())
 
 runinfo = pd.read_csv(RUNINFO_CSV)
 hold_times = np.sort(runinfo['Holding Time'].unique()) # all unique hold times in dataset
 
 results = {}
 fillucn_sum = {}
+cubes = {} # (hold_t, seg) -> summed PESummary cube [event, k]
+cube_bins_per_pe = None
 
 for _, r in runinfo.iterrows(): # aggregate all runs passing filter
     run = int(r['Run Number'])
@@ -105,14 +220,30 @@ for _, r in runinfo.iterrows(): # aggregate all runs passing filter
         for seg in SEGMENTS
     }
 
-    f = os.path.join(ANALYSIS_DIR, f'PulseAnalysis_{run}.csv')
-    if not os.path.exists(f):
-        print(f"Missing {f}, skipping run {run}.")
+    summary = load_pe_summary(run) if USE_PE_SUMMARY else None
+    if summary is not None:
+        bins_per_pe, seg_cubes = summary
+        if cube_bins_per_pe is None:
+            cube_bins_per_pe = bins_per_pe
+        if bins_per_pe == cube_bins_per_pe:
+            for seg, cube in seg_cubes.items():
+                if str(seg) not in SEGMENTS:
+                    print(f"Unknown segment {seg} in run {run}, skipping.")
+                    continue
+                key = (hold_t, seg)
+                if key not in cubes:
+                    cubes[key] = np.zeros(cube.shape, dtype=np.int64)
+                    fillucn_sum.setdefault(key, 0.0)
+                cubes[key] += cube
+                fillucn_sum[key] += per_seg_fill[str(seg)]
+            continue
+        print(f"PE summary binning differs for run {run}, using pulses instead.")
+
+    df = load_pulse_results(run)
+    if df is None:
+        print(f"Missing PulseAnalysis_{run} results, skipping run {run}.")
         continue
     
-    df = pd.read_csv(f)
-    df.columns = df.columns.str.strip()
-    
     for seg in df['Segment'].unique():
         if str(seg) not in SEGMENTS:
             print(f"Unknown segment {seg} in run {run}, skipping.")
@@ -121,7 +252,7 @@ for _, r in runinfo.iterrows(): # aggregate all runs passing filter
         key = (hold_t, seg)
         if key not in results:
             results[key] = {'times': [], 'PE': [], 'bg_flag': []}
-            fillucn_sum[key] = 0.0
+            fillucn_sum.setdefault(key, 0.0)
         
         mask = (df['Segment'].tolist() == seg)
         # if run == '26594' or run == 26594:
@@ -134,19 +265,42 @@ for _, r in runinfo.iterrows(): # aggregate all runs passing filter
         
         fillucn_sum[key] += per_seg_fill[str(seg)]
 
+def count_above(key, thresh):
+    """(signal, background) counts with PE > thresh, from pulses and/or summary cubes."""
+    sig_n = bg_n = 0
+    if key in results:
+        pe = np.array(results[key]['PE'])
+        bg_flag = np.array(results[key]['bg_flag'])
+        sig_n += np.sum((pe > thresh) & (bg_flag == 1)) # signal window events
+        bg_n += np.sum((pe > thresh) & (bg_flag == 0)) # background window events
+    if key in cubes:
+        k = int(round(thresh * cube_bins_per_pe))
+        if k < cubes[key].shape[1]:
+            sig_n += cubes[key][1, k]
+            bg_n += cubes[key][0, k]
+    return sig_n, bg_n
+
+pe_edges = np.arange(0, 200, 1)
 fig, (ax1, ax2) = plt.subplots(1, 2, figsize=(12, 5), dpi=160) # PE spectra by hold time
 for hold_t in hold_times:
-    all_pe = []
+    pe_counts = np.zeros(len(pe_edges) - 1)
     for seg in SEGMENTS:
         key = (hold_t, int(seg))
-        if key not in results:
+        if key not in results and key not in cubes:
             print(f"Missing results for hold time {hold_t}s, segment {seg}, skipping.")
             continue
-        all_pe.extend(results[key]['PE'])
-    if len(all_pe) == 0:
+        if key in results:
+            pe_counts += np.histogram(results[key]['PE'], bins=pe_edges)[0]
+        if key in cubes:
+            # cube differences at integer PE: counts in (n, n+1]
+            above = cubes[key].sum(axis=0)
+            idx = pe_edges * cube_bins_per_pe
+            above_at = np.where(idx < len(above), above[np.minimum(idx, len(above) - 1)], 0)
+            pe_counts += above_at[:-1] - above_at[1:]
+    if pe_counts.sum() == 0:
         continue
-    ax1.hist(all_pe, bins=np.arange(0, 200, 1), histtype='step', label=f'Hold {hold_t}s')
-    ax2.hist(all_pe, bins=np.arange(0, 200, 1), histtype='step', label=f'Hold {hold_t}s')
+    ax1.stairs(pe_counts, pe_edges, label=f'Hold {hold_t}s')
+    ax2.stairs(pe_counts, pe_edges, label=f'Hold {hold_t}s')
 ax1.set_title('PE distribution (linear)')
 ax1.grid(True, alpha=0.3)
 ax1.legend()
@@ -170,14 +324,10 @@ for i, seg in enumerate(SEGMENTS):
 
         for hold_t in hold_times:
             key = (hold_t, int(seg))
-            if key not in results:
+            if key not in results and key not in cubes:
                 print(f"Missing results for hold time {hold_t}s, segment {seg}, skipping.")
                 continue
-            pe = np.array(results[key]['PE'])
-            bg_flag = np.array(results[key]['bg_flag'])
-
-            sig_n = np.sum((pe > thresh) & (bg_flag == 1)) # signal window events
-            bg_n = np.sum((pe > thresh) & (bg_flag == 0)) # background window events
+            sig_n, bg_n = count_above(key, thresh)
 
             corrected = sig_n - bg_n # assumes equal 60s windows
             
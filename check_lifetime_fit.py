@@ -0,0 +1,35 @@
+"""Cross-check of the native lifetime fit (src/Lifetime_Fit.cpp via Fit_Tau) against
+fit_tau_profiled of Calculate_Lifetime.py on the shared fixture config/lifetime_fixture.csv.
+Usage: python3 check_lifetime_fit.py [Fit_Tau binary] [fixture]   (make check_lifetime)"""
+import subprocess
+import sys
+import io
+import numpy as np
+import pandas as pd
+from lifetime_fit import fit_tau_profiled
+
+FIT_TAU = sys.argv[1] if len(sys.argv) > 1 else './Fit_Tau'
+FIXTURE = sys.argv[2] if len(sys.argv) > 2 else './config/lifetime_fixture.csv'
+TAU_RTOL = 1e-4 # Powell vs grid + golden-section: same minimum of the same chi2(tau)
+DTAU_ATOL_STEPS = 1.0 # the dtau band edges sit on a 2001-point scan around each tau
+
+fixture = pd.read_csv(FIXTURE)
+native = pd.read_csv(io.StringIO(subprocess.run([FIT_TAU, FIXTURE], check=True,
+                                                capture_output=True, text=True).stdout))
+native = native.set_index('series')
+
+failed = 0
+for name, rows in fixture.groupby('series', sort=False):
+    tau, dtau = fit_tau_profiled(rows['y'].values, rows['t'].values)
+    n = native.loc[name]
+    step = 2 * max(50.0, 0.15 * tau) / 2000 # scan spacing on the Python side
+    ok_tau = abs(n['tau'] - tau) <= TAU_RTOL * tau
+    ok_dtau = (np.isnan(dtau) and np.isnan(n['dtau'])) or abs(n['dtau'] - dtau) <= DTAU_ATOL_STEPS * step
+    print(f"{name:16s} tau {tau:12.4f} / {n['tau']:12.4f}  dtau {dtau:10.4f} / {n['dtau']:10.4f}"
+          f"  {'ok' if ok_tau and ok_dtau else 'MISMATCH'}")
+    failed += not (ok_tau and ok_dtau)
+
+if failed:
+    print(f"check_lifetime_fit: {failed} series differ between Python and native")
+    sys.exit(1)
+print("check_lifetime_fit: native fit matches Calculate_Lifetime.py")
@@ -0,0 +1,23 @@
+#ifndef ALLOC_TRACKER_H
+#define ALLOC_TRACKER_H
+
+#include <atomic>
+#include <cstdint>
+
+// heap traffic of one thread since it started (only counted while allocTracking_ is on)
+struct AllocCounts {
+    uint64_t allocs = 0;
+    uint64_t bytes = 0; // requested bytes
+    uint64_t frees = 0;
+};
+
+/**
+ * Global operator new/delete hook, defined in src/Alloc_Tracker.cpp: link that file into a
+ * target to make its allocations countable (Pulse_Analysis, Pulse_Bench). Counting costs one
+ * relaxed load per allocation while off and a thread-local increment while on; in targets that
+ * do not link the hook the counters simply stay zero.
+ */
+inline std::atomic<bool> allocTracking_{false};
+inline thread_local AllocCounts threadAllocs_;
+
+#endif // ALLOC_TRACKER_H
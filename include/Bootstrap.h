@@ -0,0 +1,42 @@
+#ifndef BOOTSTRAP_H
+#define BOOTSTRAP_H
+
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+// Philox4x32-10 counter-based generator: output depends only on (counter, key), so any
+// draw can be computed independently of thread layout or evaluation order
+std::array<uint32_t, 4> philox4x32(std::array<uint32_t, 4> counter, std::array<uint32_t, 2> key);
+
+// per-run threshold counts, the same (hold, segment) inputs Calculate_Lifetime sums
+struct RunCounts {
+    int hold; // hold time (s)
+    std::vector<double> fill; // [segment] fill normalization
+    std::vector<uint8_t> present; // [segment] 1 if the run's summary has the segment
+    std::vector<uint32_t> sig; // [segment * nThresholds + t] signal-window PE > threshold
+    std::vector<uint32_t> bg;  // same for the background window
+};
+
+struct BootstrapResult {
+    size_t seg;
+    int threshold;
+    std::vector<double> taus; // per replica (NaN where the fit had < 2 hold times)
+    int nValid;
+    double mean, stddev;
+    double p16, p50, p84; // percentiles of the valid taus
+};
+
+/**
+ * Resample runs with replacement (stratified by hold time so every hold keeps its run
+ * count) and refit tau for every segment and threshold. A hold enters a segment's fit only
+ * if one of its drawn runs has the segment, the rule counts_per_hold applies to the main fit.
+ * Replica r, hold group g, draw i uses philox4x32({i, g, r, 0}, seed), so results are
+ * identical for any nThreads.
+ */
+std::vector<BootstrapResult> bootstrapLifetime(const std::vector<RunCounts>& runs, size_t nSegments,
+                                               const std::vector<int>& thresholds, int nReplicas,
+                                               uint64_t seed, int nThreads);
+
+#endif // BOOTSTRAP_H
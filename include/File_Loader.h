@@ -28,6 +28,30 @@ typedef struct
     int start_run;
     int end_run;
     bool save_to_txt;
+    std::string output_format; // "csv" (default) or "binary" PulseAnalysis results
+    bool compress_output; // zlib-compress binary result columns
+    std::string result_store; // consolidated campaign store file ("" = one file per run)
+    bool pe_summary; // opt-in: also emit per-run cumulative PE cubes (summary/PESummary_<run>.bin)
+    int threads; // worker threads for parallel stages (0 = all cores)
+    int bootstrap_replicas; // Calculate_Lifetime: bootstrap resamples over runs (0 = off)
+    uint64_t bootstrap_seed; // Philox key for the bootstrap draws
+    bool benchmark; // Pulse_Analysis: time pipeline stages, write results/benchmark_<start>_<end>.json
+    bool perf_counters; // hardware counters (perf_event_open) per stage, reported per run
+    bool fit_telemetry; // Pulse_Analysis: results/FitTelemetry_<run>.csv (per window) + .json (histograms)
+    double kernel_tolerance; // experimental, keep 0: truncate pulse kernels below this fraction of their peak
+                             // (0 = exact); fits failing the exact-kernel check are redone with the full kernel
+    bool recursive_kernel; // evaluate pulse models by exponential recurrence instead of PDF tables
+    bool incremental_likelihood; // objective calls redo only the pulses that moved (equal up to rounding)
+    double fit_memo_mb; // memory budget of the fit memo (0 = off)
+    std::string fit_memo_file; // fit memo kept across jobs (loaded at start, saved at the end; "" = in memory only)
+    int fit_memo_max_bins; // only windows up to this many bins are memoized
+    std::string fit_table; // precomputed tiny-window fits written by Make_Fit_Table ("" = off)
+    bool window_triage; // drop windows with too few hits for a pulse before histogramming (off until
+                        // shown on real data with BOBYQA to leave the pulse list unchanged)
+    int split_window_bins; // fit windows longer than this many coarse bins in overlapping parts (0 = off; at least
+                           // Pulse_Fitting::minSplitBins(), 139 at the default bins, else the run is refused)
+    bool alloc_tracking; // Pulse_Analysis: heap allocations per stage and per window, reported per run
+    std::string window_corpus; // Pulse_Analysis: append every fitted window to this replay corpus ("" = off)
 
     json runinfo_json;
     std::set<std::string> good_runs_set;
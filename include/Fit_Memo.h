@@ -0,0 +1,67 @@
+#ifndef FIT_MEMO_H
+#define FIT_MEMO_H
+
+#include <cstdint>
+#include <list>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+#include "Fit_Telemetry.h" // WindowFitStats
+
+// everything fitPulses returns for one window
+struct MemoFit {
+    bool fitted = false;
+    std::vector<double> pe, dt;
+    double nll = 0.0;
+    WindowFitStats stats;
+};
+
+/**
+ * Content-addressed memo of window fits. The key holds the full histogram and everything else the
+ * fit depends on (bin width, PDF parameters, fit settings; built by Pulse_Fitting), so a hit returns
+ * exactly what refitting would. Least recently used entries are evicted past the memory budget.
+ * Thread-safe; one memo can serve every fitter of a job.
+ *
+ * Persistence (load/save): gzip stream, little-endian
+ *   header   magic "UCNFMEM1", version uint32, reserved uint32
+ *   entry    keyLen uint32, key bytes, fitted uint8, nPulses uint32, pe f8[n], dt f8[n], nll f8,
+ *            seeds int32, pulses int32, result int32, flags uint8 (1 refit, 2 maxeval)
+ */
+class Fit_Memo {
+    public:
+        Fit_Memo(size_t budgetBytes, int maxBins);
+
+        int maxBins() const { return maxBins_; } // larger windows are not memoized
+
+        bool lookup(const std::string& key, MemoFit& fit); // copies the cached fit on a hit
+        void insert(const std::string& key, const MemoFit& fit);
+
+        bool load(const std::string& path); // merge entries from a saved memo
+        bool save(const std::string& path) const; // replaces the file
+
+        struct Stats {
+            uint64_t lookups, hits, evictions;
+            size_t entries, bytes;
+        };
+        Stats stats() const;
+
+    private:
+        typedef std::list<std::pair<std::string, MemoFit>> EntryList;
+
+        static size_t entryBytes(const std::string& key, const MemoFit& fit);
+        void insertLocked(const std::string& key, const MemoFit& fit);
+
+        size_t budget_;
+        int maxBins_;
+        mutable std::mutex mutex_;
+        EntryList lru_; // front = most recently used
+        std::unordered_map<std::string, EntryList::iterator> index_;
+        size_t bytes_ = 0;
+        uint64_t lookups_ = 0;
+        uint64_t hits_ = 0;
+        uint64_t evictions_ = 0;
+};
+
+#endif // FIT_MEMO_H
@@ -0,0 +1,66 @@
+#ifndef FIT_TABLE_H
+#define FIT_TABLE_H
+
+#include <atomic>
+#include <cstdint>
+#include <string>
+#include <vector>
+#include "Fit_Memo.h" // MemoFit
+
+class Pulse_Fitting;
+
+/**
+ * Precomputed fits of every tiny window: all histograms of 2..maxBins bins holding at most
+ * maxCounts hits, for each tabulated bin width, fitted once by Make_Fit_Table. A lookup ranks the
+ * histogram (lexicographic order among vectors with sum <= maxCounts) and reads its record, so
+ * those windows never reach NLopt. The table is tied to the fit code version and pdfParams_;
+ * load() refuses a table built for other values, regenerate it with Make_Fit_Table.
+ *
+ * File: gzip stream, little-endian
+ *   header   magic "UCNFTAB1", version uint32, fit version uint32, pdfParams f8[7],
+ *            maxBins uint32, maxCounts uint32, nBinWidths uint32, binWidths f8[nBinWidths]
+ *   records  per bin width, per nBins = 2..maxBins, in rank order (Record below)
+ */
+class Fit_Table {
+    public:
+        static const int kMaxPulses = 4; // fits with more pulses are left to the optimizer
+
+        // fit every histogram at the fitter's coarse and fine bin widths with the exact kernel
+        bool build(Pulse_Fitting& fitter, int maxBins, int maxCounts, bool verbose = true);
+        bool save(const std::string& path) const;
+        bool load(const std::string& path); // false (with a message) if missing, corrupt or stale
+
+        bool lookup(const std::vector<int>& hist, double binWidth, MemoFit& fit) const; // false: not tabulated
+
+        size_t size() const { return records_.size(); }
+        uint64_t lookups() const { return lookups_; }
+        uint64_t hits() const { return hits_; }
+
+    private:
+        struct Record {
+            uint8_t status; // 0 no fit, 1 fitted, 2 not tabulated (more than kMaxPulses pulses)
+            uint8_t nPulses;
+            uint8_t seeds;
+            uint8_t flags; // 1 refit, 2 maxeval
+            int32_t result;
+            double nll;
+            double pe[kMaxPulses];
+            double dt[kMaxPulses];
+        };
+        static_assert(sizeof(Record) == 16 + 16 * kMaxPulses, "fit table record layout is part of the file format");
+
+        void layout(); // binomials and per-shape offsets from maxBins_, maxCounts_, binWidths_
+        uint64_t count(int bins, int budget) const { return binom_[budget + bins][bins]; } // vectors with sum <= budget
+        int64_t rank(const std::vector<int>& hist) const; // -1 if outside the table
+
+        int maxBins_ = 0;
+        int maxCounts_ = 0;
+        std::vector<double> binWidths_;
+        std::vector<std::vector<uint64_t>> binom_;
+        std::vector<size_t> offset_; // first record of (binWidth index, nBins)
+        std::vector<Record> records_;
+        mutable std::atomic<uint64_t> lookups_{0};
+        mutable std::atomic<uint64_t> hits_{0};
+};
+
+#endif // FIT_TABLE_H
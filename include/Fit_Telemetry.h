@@ -0,0 +1,70 @@
+#ifndef FIT_TELEMETRY_H
+#define FIT_TELEMETRY_H
+
+#include <fstream>
+#include <map>
+#include <mutex>
+#include <string>
+#include <vector>
+#include <json.hpp>
+
+// what fitPulses did for one window (filled by fitPulses, completed by fitRegion)
+struct WindowFitStats {
+    int seeds = 0; // pulses in the initial model (gradient seeds + baseline guess)
+    int pulses = 0; // pulses returned
+    int result = 0; // nlopt::result of the last solve; 0 = no solve, -1 on an NLopt exception
+    bool refit = false; // sub-threshold pulses dropped and the reduced model solved again
+    bool maxeval = false; // some solve (first or refit) stopped on the evaluation cap
+    bool kernelFallback = false; // the truncated-kernel fit failed its exact-kernel check and was solved again
+    bool memoHit = false; // served from the fit memo: no solve, the other fields are the cached fit's
+    bool tableHit = false; // same for the fit table
+};
+
+struct WindowFitRecord {
+    std::string segment;
+    bool signal;
+    double startTime; // us
+    int nBins;
+    double binWidth; // us
+    WindowFitStats stats;
+    long evals; // negLogLikelihood calls over both solves (cap is 200 per solve)
+    double fitUs; // fitPulses wall time
+};
+
+/**
+ * Per-window fit telemetry for one run: a CSV row per window plus aggregated histograms
+ * (evaluations, result codes, pulse counts, log2 fit time) and the slowest windows, written
+ * as JSON by writeSummary(). Fit memo and table hits are counted apart from solved windows.
+ * Thread-safe; share one instance across the segments of a run.
+ */
+class Fit_Telemetry {
+    public:
+        Fit_Telemetry(int run, const std::string& csvPath); // throws if the CSV cannot be opened
+
+        void record(const WindowFitRecord& w);
+        nlohmann::json summary() const;
+        bool writeSummary(const std::string& path) const;
+
+    private:
+        static const int kEvalBinWidth = 10; // evaluation histogram: 10 per bin, last bin 200+
+        static const int kEvalBins = 21;
+        static const size_t kSlowest = 20;
+
+        int run_;
+        std::ofstream csv_;
+        mutable std::mutex mutex_;
+        size_t nWindows_ = 0;
+        size_t nMemoHits_ = 0; // windows served from the fit memo: left out of the solver counts below
+        size_t nTableHits_ = 0; // windows served from the fit table: same
+        size_t nRefits_ = 0;
+        size_t nMaxEval_ = 0; // windows where any solve stopped on the evaluation cap
+        size_t nKernelFallbacks_ = 0; // windows refitted with the full kernel (kernel_tolerance)
+        double totalFitUs_ = 0.0;
+        std::vector<size_t> evalHist_;
+        std::map<int, size_t> resultCounts_;
+        std::map<int, size_t> pulseCounts_;
+        std::map<int, size_t> fitTimeLog2_; // floor(log2(us)) -> windows
+        std::vector<WindowFitRecord> slowest_; // kSlowest largest fitUs, unordered
+};
+
+#endif // FIT_TELEMETRY_H
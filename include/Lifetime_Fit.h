@@ -0,0 +1,22 @@
+#ifndef LIFETIME_FIT_H
+#define LIFETIME_FIT_H
+
+#include <vector>
+
+struct TauFit {
+    double tau; // best-fit lifetime (s)
+    double dtau; // half width of the delta-chi2 = 1 band (NaN if not found)
+    double amplitude; // profiled A at tau
+    double chi2; // chi2 at tau
+};
+
+// Fit y_i = A exp(-t_i / tau) with A profiled analytically (port of fit_tau_profiled in
+// Calculate_Lifetime.py): sigma_i = sqrt(max(y_i, 1e-9)), tau in [1, 1e6] s, then a
+// 2001-point scan of +-max(50, 0.15 tau) around the minimum for the delta-chi2 = 1 band.
+// Differences from the Python fit (check_lifetime_fit.py compares both on config/lifetime_fixture.csv):
+// - tau is minimized by a 241-point log grid plus golden-section search, not Powell from 800 s;
+//   both land on the same minimum when chi2(tau) has one, the grid also when it has several.
+// - dtau is the band half width in seconds; Calculate_Lifetime.py plots dtau / 10000.
+TauFit fitTauProfiled(const std::vector<double>& counts, const std::vector<double>& ts, bool scanErrors = true);
+
+#endif // LIFETIME_FIT_H
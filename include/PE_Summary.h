@@ -0,0 +1,38 @@
+#ifndef PE_SUMMARY_H
+#define PE_SUMMARY_H
+
+#include <cstdint>
+#include <string>
+#include <vector>
+#include "Pulse_Output.h" // For RunPulses
+
+/**
+ * Per-run threshold-scan cube: for each segment and window (0 = background, 1 = signal),
+ * above[k] = number of pulses with PE > k / binsPerPE, k = 0 .. nBins-1.
+ * Any "PE > threshold" count is then a single lookup, and cubes of different runs add.
+ * Counts are exact for thresholds on the 1/binsPerPE grid; PE beyond the range saturates
+ * into the last bin.
+ */
+struct PESummary {
+    int run = 0;
+    uint32_t binsPerPE = 10; // 0.1 PE resolution
+    uint32_t nBins = 0;
+    std::vector<std::string> labels;
+    std::vector<uint32_t> above; // [segment][event][k]
+
+    const uint32_t* cumulative(size_t seg, int event) const { return above.data() + (seg * 2 + event) * nBins; }
+    uint32_t countAbove(size_t seg, int event, double threshold) const; // PE > threshold
+    bool add(const PESummary& other); // aggregate runs by segment label; false if the binning differs
+};
+
+PESummary buildPESummary(const RunPulses& pulses, int run, uint32_t binsPerPE = 10, double maxPE = 300.0);
+
+// header (magic "UCNPESM1", run, nSegments, binsPerPE, nBins, byte counts), labels char[8]
+// per segment, then the zlib-compressed <u4 cube
+std::vector<char> encodePESummary(const PESummary& summary);
+bool decodePESummary(const char* data, size_t size, PESummary& summary);
+
+bool writePESummary(const PESummary& summary, const std::string& path);
+bool readPESummary(const std::string& path, PESummary& summary);
+
+#endif // PE_SUMMARY_H
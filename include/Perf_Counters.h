@@ -0,0 +1,88 @@
+#ifndef PERF_COUNTERS_H
+#define PERF_COUNTERS_H
+
+#include <array>
+#include <cerrno>
+#include <cstdint>
+#include <cstring>
+#include <string>
+#include <linux/perf_event.h>
+#include <sys/ioctl.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+
+// hardware events read as one group (all four are scheduled together, so ratios are consistent)
+enum PerfEvent { PerfCycles, PerfInstructions, PerfCacheMisses, PerfBranchMisses, kPerfEvents };
+using PerfValues = std::array<uint64_t, kPerfEvents>;
+
+inline const char* perfEventName(int k) {
+    static const char* names[] = {"cycles", "instructions", "cache_misses", "branch_misses"};
+    return names[k];
+}
+
+/**
+ * perf_event_open counter group for the calling thread, user space only. Opening fails on
+ * kernels without PMU access (perf_event_paranoid > 2, most containers/VMs); check ok().
+ * Reading is one read() syscall (~1 us): wrap stages, not individual likelihood calls.
+ */
+class PerfCounterGroup {
+    public:
+        PerfCounterGroup() {
+            const uint64_t configs[kPerfEvents] = {PERF_COUNT_HW_CPU_CYCLES, PERF_COUNT_HW_INSTRUCTIONS,
+                                                   PERF_COUNT_HW_CACHE_MISSES, PERF_COUNT_HW_BRANCH_MISSES};
+            fds_.fill(-1);
+            for (int k = 0; k < kPerfEvents; ++k) {
+                perf_event_attr attr;
+                memset(&attr, 0, sizeof(attr));
+                attr.size = sizeof(attr);
+                attr.type = PERF_TYPE_HARDWARE;
+                attr.config = configs[k];
+                attr.disabled = k == 0; // the leader starts the whole group
+                attr.exclude_kernel = 1;
+                attr.exclude_hv = 1;
+                attr.read_format = PERF_FORMAT_GROUP;
+                fds_[k] = static_cast<int>(syscall(__NR_perf_event_open, &attr, 0, -1, k == 0 ? -1 : fds_[0], 0));
+                if (fds_[k] < 0) {
+                    error_ = std::string(perfEventName(k)) + ": " + strerror(errno);
+                    return;
+                }
+            }
+            ioctl(fds_[0], PERF_EVENT_IOC_RESET, PERF_IOC_FLAG_GROUP);
+            ioctl(fds_[0], PERF_EVENT_IOC_ENABLE, PERF_IOC_FLAG_GROUP);
+            ok_ = true;
+        }
+
+        ~PerfCounterGroup() {
+            for (int fd : fds_) if (fd >= 0) close(fd);
+        }
+
+        PerfCounterGroup(const PerfCounterGroup&) = delete;
+        PerfCounterGroup& operator=(const PerfCounterGroup&) = delete;
+
+        bool ok() const { return ok_; }
+        const std::string& error() const { return error_; } // why opening failed
+
+        // running totals since the group was opened
+        bool read(PerfValues& values) const {
+            if (!ok_) return false;
+            uint64_t buf[1 + kPerfEvents]; // PERF_FORMAT_GROUP: nr, then one value per event
+            if (::read(fds_[0], buf, sizeof(buf)) != static_cast<ssize_t>(sizeof(buf)) || buf[0] != kPerfEvents) {
+                return false;
+            }
+            for (int k = 0; k < kPerfEvents; ++k) values[k] = buf[1 + k];
+            return true;
+        }
+
+    private:
+        std::array<int, kPerfEvents> fds_;
+        bool ok_ = false;
+        std::string error_;
+};
+
+// one group per thread, opened on first use
+inline PerfCounterGroup& threadPerfCounters() {
+    thread_local PerfCounterGroup group;
+    return group;
+}
+
+#endif // PERF_COUNTERS_H
@@ -0,0 +1,17 @@
+#ifndef PLOT_TAIL_H
+#define PLOT_TAIL_H
+
+#include <string>
+#include <vector>
+
+// read a tail CSV written by SaveTail (Pulse_Tail); returns false if unreadable
+bool LoadTail(const std::string& input_path,
+              std::vector<std::vector<double>>& tails,
+              std::vector<std::string>& segment_labels,
+              double& binWidth);
+
+// render linear + log-y tail overlays to an image (batch mode, no display)
+void PlotTail(const std::vector<std::vector<double>>& tails, const std::vector<std::string>& segment_labels,
+              double binWidth, const std::string& output_path);
+
+#endif // PLOT_TAIL_H
@@ -5,9 +5,17 @@
 #include <json.hpp>
 #include <vector>
 #include "File_Loader.h" // For EventList
+#include "Result_Store.h"
+#include "Window_Corpus.h"
+#include "Fit_Memo.h"
+#include "Fit_Table.h"
 
 using json = nlohmann::json;
 
-void analysis_setup(const std::vector<EventList> run_data, json params, std::string output_folder);
+void analysis_setup(const std::vector<EventList>& run_data, json params, std::string output_folder, const Config& cfg,
+                    Result_Store* store = nullptr, // store: commit results there instead of per-run files
+                    Window_Corpus* corpus = nullptr, // corpus: record every fitted window for replay
+                    Fit_Memo* memo = nullptr, // memo: reuse fits of repeated small windows
+                    const Fit_Table* table = nullptr); // table: precomputed fits of tiny windows
 
 #endif // PULSE_ANALYSIS_H
\ No newline at end of file
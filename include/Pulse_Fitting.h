@@ -6,7 +6,13 @@
 #include <map>
 #include <utility>
 #include <cmath>
+#include <limits>
 #include "File_Loader.h" // For EventList
+#include "Pulse_Table.h"
+#include "Window_Corpus.h"
+#include "Fit_Telemetry.h"
+#include "Fit_Memo.h"
+#include "Fit_Table.h"
 
 struct PDFParams {
     // parameters for the PDF model of PE response from the PMTs
@@ -22,17 +28,56 @@ std::vector<double> makeLogFactorialTable(int max_k);
 std::vector<double> makeLogLambdaTable();
 double getLogLambda(double lam);
 
+// one part of a split window for Pulse_Fitting::fitBatch; the fit results are written back into it
+struct BatchWindow {
+    std::vector<int> hist;
+    double binWidth; // us
+    double startTime = 0.0; // us (caller bookkeeping)
+    double windowWidth = 0.0; // us (caller bookkeeping)
+
+    bool fitted = false;
+    std::vector<double> pe, dt; // fitted PE and shift (bins) per pulse
+    double nll = 0.0;
+    WindowFitStats stats;
+    long evals = 0; // negLogLikelihood calls
+    double fitUs = 0.0; // fit wall time, only measured while telemetry is on
+
+    // split windows (fitRegion): each part keeps only its pulses in [keepFrom, keepTo) (us)
+    double keepFrom = -std::numeric_limits<double>::infinity();
+    double keepTo = std::numeric_limits<double>::infinity();
+};
+
 class Pulse_Fitting {
+    friend class Pulse_Bench; // microbenchmarks drive the private stages directly
+    friend class Fit_Table; // Make_Fit_Table runs solvePulses over every tabulated window
+
+
     public:
+        static const uint32_t kFitVersion = 3; // bump when solvePulses gives a different result for the same inputs
+        static const int kMinPE = 5; // smallest pulse solvePulses keeps
+        static int minSplitBins(double binWidth = 1.0, double minGap = 10.0); // smallest maxBins setWindowSplitting takes
+        static constexpr double kKernelCheckNLL = 0.1; // truncated-kernel fit: max |exact - truncated| NLL at its solution
+
         // events: raw PE hits (list of 'event'); binWidth: coarse hist bin (us); minGap: break windows (us)
         Pulse_Fitting(const EventList& events, double binWidth = 1.0, double minGap = 10.0);
 
         void setWindow(double start_us, double stop_us); // signal window [start, stop) in us
         void setBackgroundWindow(double start_us); // background window [start, start+60s)
+        void setCorpus(Window_Corpus* corpus, int run, const std::string& segment); // record every fitted window
+        void setTelemetry(Fit_Telemetry* telemetry, const std::string& segment); // per-window fit statistics
+        void setKernelTolerance(double relTol); // experimental: truncate the pulse kernel below relTol x peak (0 = full kernel)
+        void setRecursiveKernel(bool on); // expected counts by exponential recurrence, no PDF tables
+        void setIncrementalLikelihood(bool on); // update only the pulses that moved between evaluations
+        void setFitMemo(Fit_Memo* memo); // reuse fits of identical small windows (not owned; nullptr = off)
+        void setFitTable(const Fit_Table* table); // precomputed fits of tiny windows (not owned; nullptr = off)
+        void setWindowTriage(bool on); // skip windows with fewer than kMinPE hits before histogramming
+        bool setWindowSplitting(int maxBins); // fit windows over maxBins coarse bins in overlapping parts (0 = off); false below minSplitBins
         void analyze(); // build windows, fit pulses, fill outputs
 
-        const std::vector<std::tuple<double, double, int, double, bool>>& getSignalPulses() const { return signalPulses_; }
-        const std::vector<std::tuple<double, double, int, double, bool>>& getBackgroundPulses() const { return backgroundPulses_; }
+        const PulseTable& getSignalPulses() const { return signalPulses_; }
+        const PulseTable& getBackgroundPulses() const { return backgroundPulses_; }
+        PulseTable takeSignalPulses() { return std::move(signalPulses_); } // move out, fitter keeps an empty table
+        PulseTable takeBackgroundPulses() { return std::move(backgroundPulses_); }
 
     private:
         double binWidth_; // primary histogram bin (us)
@@ -45,11 +90,88 @@ class Pulse_Fitting {
 
         std::map<std::pair<int, double>, std::vector<std::vector<double>>> pdfCache_; // keyed by (nbins, binWidth)
 
-        // each tuple: (pulse_time_us, PE, window_index, window_width_us, is_pileup)
-        std::vector<std::tuple<double, double, int, double, bool>> signalPulses_;
-        std::vector<std::tuple<double, double, int, double, bool>> backgroundPulses_;
+        PulseTable signalPulses_;
+        PulseTable backgroundPulses_;
         double peBackgroundRate_;
         double eventBackgroundRate_;
+        long nllEvals_ = 0; // negLogLikelihood calls so far (benchmark diagnostics)
+        double kernelTolerance_ = 0.0; // relative kernel cutoff; 0 keeps the exact full-window likelihood
+        int kernelSupport_ = 0; // bins per pulse the sparse kernel updates (set per window)
+        double kernelFloor_ = 0.0; // pdf value at the cut: expectation per PE past a pulse's support
+        bool recursiveKernel_ = false; // fit without pdfLookup tables (negLogLikelihoodRecursive)
+
+        // the normalized tri-exponential over one window's bins as decaying components:
+        // basePDF[offset + m] = sum_c amp[c] * decay[c]^m, and 0 before offset
+        struct ExpKernel {
+            double amp[3];
+            double decay[3];
+            int offset; // first bin at or after pdfParams_.loc
+        };
+        ExpKernel expKernel_;
+
+        // state of the last objective call of the current solve: each pulse's share of every occupied
+        // bin and its kernel mass on the empty bins, so a call only redoes the pulses that moved
+        struct IncrementalNLL {
+            bool valid = false; // reset before each solve
+            std::vector<double> params; // last evaluated point
+            std::vector<int> occupied; // bins with hits
+            std::vector<double> contrib; // PE x kernel of each pulse at each occupied bin, [bin][pulse]
+            std::vector<double> terms; // Poisson term at each occupied bin
+            std::vector<double> emptyMass; // per pulse: PE x kernel mass on the empty bins
+            std::vector<double> massPrefix; // massPrefix[m] = kernel mass of its first m bins
+            long binsEvaluated = 0; // diagnostics: Poisson terms recomputed / bins a full evaluation would touch
+            long binsTotal = 0;
+        };
+        bool incrementalLikelihood_ = false;
+        bool windowTriage_ = false;
+        int splitBins_ = 0; // longest window (coarse bins) fitted whole; 0 = never split
+        Fit_Memo* memo_ = nullptr;
+        const Fit_Table* fitTable_ = nullptr;
+        IncrementalNLL incremental_;
+
+        Window_Corpus* corpus_ = nullptr; // replay capture (not owned); nullptr = off
+        int corpusRun_ = 0;
+        std::string corpusSegment_;
+
+        Fit_Telemetry* telemetry_ = nullptr; // not owned; nullptr = off
+        std::string telemetrySegment_;
+        WindowFitStats lastFit_; // filled by fitPulses for the telemetry record
+
+        // a fitted pulse of one part of a split window, as emitWindow sorts them out
+        struct PartPulse {
+            double t; // us
+            int part, k; // parts[part].pe[k]
+            bool keep; // inside its part's core, or the survivor of a merge
+            bool merged; // the same pulse as a neighbour part's, which is kept instead
+            bool paired; // matched with a neighbour part's pulse (each pulse at most once)
+        };
+
+        // per-window working buffers: cleared, never freed, so once they have grown to the
+        // largest window seen the window loop no longer touches the heap (NLopt's own state aside).
+        // That cuts allocations only: Pulse_Bench shows no gain in fitRegion time per window
+        struct Scratch {
+            std::vector<int> hist;
+            std::vector<double> xCenters;
+            std::vector<double> expected; // negLogLikelihood model, one per objective call
+            std::vector<double> grad; // findGradientPeaks
+            std::vector<int> peaks;
+            std::vector<double> peGuess, dtGuess; // seeds
+            std::vector<double> params, lb, ub; // NLopt vector [PE..., dt...] and bounds
+            std::vector<double> finalPEs, finalDTs; // above-threshold pulses of the first solve
+            std::vector<double> fittedPEs, fittedDTs; // fitRegion's fitPulses output
+            std::vector<double> countPrefix, logFactPrefix; // sparse kernel: prefix sums of k and log(k!)
+            std::vector<std::pair<int, int>> spans; // sparse kernel: [dt, dt + support) per pulse, by dt
+            std::vector<int> spanPulse; // pulse index of each span
+            std::vector<const double*> rows; // pdfLookup row of each pulse
+            std::vector<size_t> batchOrder; // fitBatch: window indices sorted by shape
+            std::vector<int> splitCounts; // splitWindow: hits per coarse bin of the whole window
+            std::vector<BatchWindow> splitParts; // fitRegion: parts of one split window
+            std::vector<PartPulse> partPulses; // emitWindow: pulses in or next to their part's core
+            std::vector<std::pair<double, std::pair<int, int>>> mergePairs; // emitWindow: (|dt|, partPulses indices)
+            std::string memoKey;
+            MemoFit memoFit;
+        };
+        Scratch scratch_;
 
         // === HELPER METHODS === //
 
@@ -58,17 +180,34 @@ class Pulse_Fitting {
         std::vector<double> applyTimeWindow(const std::vector<double>& times, double start, double end); // [start, end)
         
         std::tuple<double, int, double, double> movingWindow(const std::vector<double>& times, int startIdx); // grow window by minGap_
+
+        size_t countWindows(const std::vector<double>& times) const; // number of movingWindow windows (reserve hint)
         
         bool makeHistogram(const std::vector<double>& times, int i, double binWidth,
                         double& windowWidth, int& j, double& startTime, double& endTime,
                         std::vector<int>& hist, std::vector<double>& xCenters); // build window hist from times[i...j)
+
+        bool fillHistogram(const std::vector<double>& times, int i, int j, double startTime, double windowWidth,
+                           double binWidth, std::vector<int>& hist, std::vector<double>& xCenters); // movingWindow done
+
+        // why fitRegion drops a window before any histogram or kernel work
+        enum class Triage { Keep, Narrow, FewHits };
+        Triage triageWindow(int hits, double windowWidth) const;
+
+        // cut times[i...j) at low-density valleys into overlapping parts, appended at parts[nParts...]
+        void splitWindow(const std::vector<double>& times, int i, int j, double windowWidth, bool signal,
+                         std::vector<BatchWindow>& parts, size_t& nParts);
+        static double splitOverlap(double minGap); // us each split part extends past its core on either side
+        // store one window's fitted parts (a single entry unless split) as one output window
+        void emitWindow(const BatchWindow* parts, size_t n, bool signal, PulseTable& output, int& windowCount);
+        void fitBatch(std::vector<BatchWindow>& windows); // fit windows grouped by shape, one kernel per group
         
-        void fitRegion(const std::vector<double>& data_us,
-                    std::vector<std::tuple<double, double, int, double, bool>>& output);
+        void fitRegion(const std::vector<double>& data_us, PulseTable& output);
 
         std::vector<double> analyticPDF(const std::vector<double>& x, int shift = 0); // tri-exp mixture over bins (normalized)
         
-        std::vector<std::vector<double>> generatePDFLookup(const std::vector<double>& xCenters); // cached shifted PDFs
+        // cached shifted PDFs; the reference stays valid until pdfCache_ is cleared
+        const std::vector<std::vector<double>>& generatePDFLookup(const std::vector<double>& xCenters);
 
         double poissonLogLikelihood(const std::vector<int>& observed,
                                     const std::vector<double>& expected);
@@ -78,11 +217,52 @@ class Pulse_Fitting {
                                 const std::vector<std::vector<double>>& pdfLookup,
                                 int nPulses); // seed candidates
 
-        std::vector<int> findGradientPeaks(const std::vector<int>& hist, double threshold, int ignoreIdx); // NLOpt fit over PE, DT per pulse
+        // negLogLikelihood with the pulse loop unrolled for a fixed pulse count; same sums, same order
+        template <int N>
+        double negLogLikelihoodN(const std::vector<double>& params,
+                                 const std::vector<int>& observed,
+                                 const std::vector<std::vector<double>>& pdfLookup,
+                                 int nPulses);
+
+        using NLLKernel = double (Pulse_Fitting::*)(const std::vector<double>&, const std::vector<int>&,
+                                                    const std::vector<std::vector<double>>&, int);
+        static NLLKernel nllKernel(int nPulses); // specialized kernel for 1..4 pulses, else negLogLikelihood
+
+        // truncated kernel: only the kernelSupport_ bins after each pulse are evaluated, later bins sit at
+        // kernelFloor_ x PE and enter through prefix sums; O(pulses x support) instead of O(pulses x nBins)
+        double negLogLikelihoodSparse(const std::vector<double>& params,
+                                      const std::vector<int>& observed,
+                                      const std::vector<std::vector<double>>& pdfLookup,
+                                      int nPulses);
+        bool prepareSparseKernel(const std::vector<int>& hist,
+                                 const std::vector<std::vector<double>>& pdfLookup); // false: window fits the support
+
+        // one O(nBins) recurrence per exponential component; pdfLookup is not used
+        double negLogLikelihoodRecursive(const std::vector<double>& params,
+                                         const std::vector<int>& observed,
+                                         const std::vector<std::vector<double>>& pdfLookup,
+                                         int nPulses);
+        void prepareRecursiveKernel(const std::vector<double>& xCenters); // expKernel_ for this window
+
+        // negLogLikelihood from cached per-pulse contributions; occupied bins bit-identical, empty bins up to rounding
+        double negLogLikelihoodIncremental(const std::vector<double>& params,
+                                           const std::vector<int>& observed,
+                                           const std::vector<std::vector<double>>& pdfLookup,
+                                           int nPulses);
+
+        void findGradientPeaks(const std::vector<int>& hist, double threshold, int ignoreIdx,
+                               std::vector<int>& peaks); // seed bins (relative to ignoreIdx) into 'peaks'
                                 
+        // NLOpt fit over PE, DT per pulse (through the fit table and the fit memo when set)
         bool fitPulses(const std::vector<int>& hist, const std::vector<double>& xCenters,
                     const std::vector<std::vector<double>>& pdfLookup,
-                    std::vector<double>& fittedPEs, std::vector<double>& fittedDTs);
+                    std::vector<double>& fittedPEs, std::vector<double>& fittedDTs, double& fitNLL);
+
+        bool solvePulses(const std::vector<int>& hist, const std::vector<double>& xCenters,
+                    const std::vector<std::vector<double>>& pdfLookup,
+                    std::vector<double>& fittedPEs, std::vector<double>& fittedDTs, double& fitNLL);
+
+        void buildMemoKey(const std::vector<int>& hist, double binWidth, std::string& key) const;
 };
 
 #endif // PULSE_FITTING_H
\ No newline at end of file
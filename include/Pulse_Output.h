@@ -0,0 +1,47 @@
+#ifndef PULSE_OUTPUT_H
+#define PULSE_OUTPUT_H
+
+#include <string>
+#include <vector>
+#include "Pulse_Table.h"
+
+// fitted pulses of one PMT segment (signal + background windows)
+struct SegmentPulses {
+    std::string label; // "12", "34", "56", "78"
+    PulseTable signal;
+    PulseTable background;
+};
+
+using RunPulses = std::vector<SegmentPulses>;
+
+// PulseAnalysis_<run>.csv: "Segment, Time (us), PE, Event" (time written in seconds)
+bool writePulseCSV(const RunPulses& pulses, const std::string& path);
+bool readPulseCSV(const std::string& path, RunPulses& pulses); // PE/time/event only
+
+/**
+ * PulseAnalysis_<run>.bin: little-endian columnar layout, numpy-memmap friendly
+ *
+ *   header (64 B)    magic "UCNPCOL1", version, flags (bit0 = zlib), run,
+ *                    nColumns, nGroups, nRows, directory offsets
+ *   group index      one row group per (segment, event): label[8], event (1 = signal,
+ *                    0 = background), firstRow, nRows
+ *   column index     name[24], numpy dtype string[8] ("<f8", "<i4", "|u1")
+ *   chunk index      nColumns x nGroups of {offset, storedBytes, rawBytes}
+ *   chunks           column-major; uncompressed columns are contiguous and 64 B aligned
+ *
+ * columns: time_us <f8, pe <f8, window <i4, width_us <f8, pileup |u1, nll <f8
+ */
+std::vector<char> encodePulseBinary(const RunPulses& pulses, int run, bool compress);
+bool decodePulseBinary(const char* data, size_t size, RunPulses& pulses, int& run);
+
+// summed tail payload for the result store: header (magic "UCNTAIL1", nSegments, nBins,
+// binWidth), labels char[8] per segment, then nSegments x nBins <f8 counts
+std::vector<char> encodeTailBinary(const std::vector<std::vector<double>>& tails,
+                                   const std::vector<std::string>& segment_labels, double binWidth);
+bool decodeTailBinary(const char* data, size_t size, std::vector<std::vector<double>>& tails,
+                      std::vector<std::string>& segment_labels, double& binWidth);
+
+bool writePulseBinary(const RunPulses& pulses, int run, const std::string& path, bool compress = false);
+bool readPulseBinary(const std::string& path, RunPulses& pulses, int& run);
+
+#endif // PULSE_OUTPUT_H
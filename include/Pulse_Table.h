@@ -0,0 +1,40 @@
+#ifndef PULSE_TABLE_H
+#define PULSE_TABLE_H
+
+#include <vector>
+#include <cstddef>
+#include <cstdint>
+
+// Columnar store of fitted pulses: one entry per pulse, one vector per field
+struct PulseTable {
+    std::vector<double> time;    // pulse time (us)
+    std::vector<double> pe;      // fitted PE
+    std::vector<int> window;     // window index within the fitted region
+    std::vector<double> width;   // window width (us)
+    std::vector<uint8_t> pileup; // 1 if the window held more than one pulse
+    std::vector<double> nll;     // -logL of the window fit at the minimum (fit quality)
+
+    size_t size() const { return time.size(); }
+    bool empty() const { return time.empty(); }
+
+    void reserve(size_t n) {
+        time.reserve(n); pe.reserve(n); window.reserve(n);
+        width.reserve(n); pileup.reserve(n); nll.reserve(n);
+    }
+
+    void clear() {
+        time.clear(); pe.clear(); window.clear();
+        width.clear(); pileup.clear(); nll.clear();
+    }
+
+    void push_back(double t, double PE, int windowIdx, double windowWidth, bool isPileup, double fitNLL) {
+        time.push_back(t);
+        pe.push_back(PE);
+        window.push_back(windowIdx);
+        width.push_back(windowWidth);
+        pileup.push_back(isPileup ? 1 : 0);
+        nll.push_back(fitNLL);
+    }
+};
+
+#endif // PULSE_TABLE_H
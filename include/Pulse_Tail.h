@@ -3,15 +3,16 @@
 
 #include <string>
 #include <vector>
-#include <tuple>
 #include "File_Loader.h" // For EventList
+#include "Pulse_Table.h"
 
 std::vector<double> accumulateTailHistogram(
-    const std::vector<std::tuple<double, double, int, double, bool>>& pulses,
+    const PulseTable& pulses,
     const EventList& run_data,
     double binWidth, 
     double maxTime);
 
-void PlotTail(const std::vector<std::vector<double>>& tails, const std::vector<std::string>& segment_labels, const std::string& output_path);
+void SaveTail(const std::vector<std::vector<double>>& tails, const std::vector<std::string>& segment_labels,
+              const std::string& output_path, double binWidth = 0.1);
 
 #endif // PULSE_TAIL_H
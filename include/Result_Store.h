@@ -0,0 +1,67 @@
+#ifndef RESULT_STORE_H
+#define RESULT_STORE_H
+
+#include <cstdint>
+#include <map>
+#include <mutex>
+#include <string>
+#include <utility>
+#include <vector>
+
+// what a store record holds; a run has at most one live record per kind
+enum class RecordKind : uint32_t {
+    Pulses = 1, // encodePulseBinary payload (segment row groups inside)
+    Tail = 2,   // encodeTailBinary payload
+    Summary = 3, // encodePESummary payload
+};
+
+/**
+ * Append-only, one-file-per-campaign result store
+ *
+ *   file header (32 B)  magic "UCNSTOR1", version
+ *   record              header (32 B: magic, kind, run, payload bytes, crc32)
+ *                       payload
+ *                       commit trailer (32 B: magic, kind, run, record offset, previous trailer)
+ *
+ * A record only exists once its trailer is written (after the payload is synced), so a
+ * crashed writer leaves an ignorable tail. Trailers chain backwards from EOF, which is
+ * how the run index is rebuilt; fetching a run afterwards is a single pread. Commits are
+ * serialized with a mutex (threads) and an fcntl write lock (processes), so share one
+ * instance per process. Re-committing a run supersedes the earlier record.
+ */
+class Result_Store {
+    public:
+        explicit Result_Store(const std::string& path); // create if missing; throws on I/O error
+        ~Result_Store();
+
+        Result_Store(const Result_Store&) = delete;
+        Result_Store& operator=(const Result_Store&) = delete;
+
+        bool commit(RecordKind kind, int run, const std::vector<char>& payload); // atomic per run
+        bool fetch(RecordKind kind, int run, std::vector<char>& payload); // false if absent/corrupt
+        bool contains(RecordKind kind, int run);
+        std::vector<int> runs(RecordKind kind); // sorted run numbers with a live record
+        void refresh(); // pick up commits made by other processes
+
+        const std::string& path() const { return path_; }
+
+    private:
+        struct Entry {
+            uint64_t offset; // record header offset
+            uint64_t payloadBytes;
+            uint32_t crc;
+        };
+
+        std::string path_;
+        int fd_;
+        std::mutex mutex_;
+        std::map<std::pair<uint32_t, int>, Entry> index_; // (kind, run) -> latest record
+        uint64_t lastTrailer_; // offset of the newest trailer in index_ (0 = none)
+
+        void lockFile(bool exclusive);
+        void unlockFile();
+        uint64_t validEnd(uint64_t fileSize, uint64_t& lastTrailer); // end of the last complete record
+        void updateIndex(); // caller holds mutex_ (+ file lock)
+};
+
+#endif // RESULT_STORE_H
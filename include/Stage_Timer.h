@@ -0,0 +1,168 @@
+#ifndef STAGE_TIMER_H
+#define STAGE_TIMER_H
+
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <iomanip>
+#include <ostream>
+#include "Perf_Counters.h"
+#include "Alloc_Tracker.h"
+
+// pipeline stages of Pulse_Analysis, in processing order
+enum class Stage : int {
+    RootLoad,           // TFile open + tree reads (processfile)
+    ChannelRouting,     // channel -> segment lists (processfile)
+    TimeExtraction,     // realtime -> us vectors, signal/background cuts
+    WindowSegmentation, // movingWindow + histogramming
+    KernelBuild,        // generatePDFLookup
+    Fitting,            // fitPulses (NLopt)
+    Output,             // result files / store commits
+    TailAccumulation,   // Pulse_Tail: PE tail histograms
+    Count
+};
+
+inline const char* stageName(Stage s) {
+    static const char* names[] = {"root_load", "channel_routing", "time_extraction", "window_segmentation",
+                                  "kernel_build", "fitting", "output", "tail_accumulation"};
+    return names[static_cast<int>(s)];
+}
+
+const int kStages = static_cast<int>(Stage::Count);
+
+// process-wide wall time (and optionally hardware counters / heap traffic) per stage plus
+// throughput counters; off unless a benchmark, perf_counters or alloc_tracking run enables it
+struct StageTotals {
+    std::atomic<bool> enabled{false};
+    std::atomic<bool> perf{false}; // also accumulate PerfCounterGroup deltas
+    std::atomic<uint64_t> ns[kStages] = {};
+    std::atomic<uint64_t> counters[kStages][kPerfEvents] = {};
+    std::atomic<uint64_t> allocs[kStages] = {}; // while allocTracking_ (needs the Alloc_Tracker hook)
+    std::atomic<uint64_t> allocBytes[kStages] = {};
+    std::atomic<uint64_t> runs{0};
+    std::atomic<uint64_t> peHits{0};
+    std::atomic<uint64_t> windows{0};
+    std::atomic<uint64_t> triagedNarrow{0}; // windows dropped before histogramming, by reason
+    std::atomic<uint64_t> triagedFewHits{0};
+
+    void count(std::atomic<uint64_t>& counter, uint64_t n) {
+        if (enabled.load(std::memory_order_relaxed)) counter.fetch_add(n, std::memory_order_relaxed);
+    }
+};
+
+inline StageTotals stageTotals_;
+
+// turn on stage accounting, with hardware counters if requested and the kernel allows it
+inline void enableStageAccounting(bool perfCounters, bool allocTracking, std::ostream& log) {
+    stageTotals_.enabled = true;
+    if (allocTracking) allocTracking_ = true;
+    if (!perfCounters) return;
+    PerfCounterGroup& group = threadPerfCounters();
+    if (group.ok()) {
+        stageTotals_.perf = true;
+    } else {
+        log << "Hardware counters unavailable (" << group.error() << "), timing only" << std::endl;
+    }
+}
+
+// adds the scope's wall time (and counter deltas) to its stage; one relaxed load when disabled
+class ScopedStage {
+    public:
+        explicit ScopedStage(Stage stage)
+            : stage_(stage), active_(stageTotals_.enabled.load(std::memory_order_relaxed)), perf_(nullptr)
+        {
+            if (!active_) return;
+            if (stageTotals_.perf.load(std::memory_order_relaxed)) {
+                perf_ = &threadPerfCounters();
+                if (!perf_->read(startCounts_)) perf_ = nullptr;
+            }
+            startAllocs_ = threadAllocs_;
+            start_ = std::chrono::steady_clock::now();
+        }
+
+        ~ScopedStage() {
+            if (!active_) return;
+            auto ns = std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - start_);
+            int s = static_cast<int>(stage_);
+            stageTotals_.ns[s].fetch_add(ns.count(), std::memory_order_relaxed);
+            stageTotals_.allocs[s].fetch_add(threadAllocs_.allocs - startAllocs_.allocs, std::memory_order_relaxed);
+            stageTotals_.allocBytes[s].fetch_add(threadAllocs_.bytes - startAllocs_.bytes, std::memory_order_relaxed);
+            PerfValues end;
+            if (perf_ && perf_->read(end)) {
+                for (int k = 0; k < kPerfEvents; ++k) {
+                    stageTotals_.counters[s][k].fetch_add(end[k] - startCounts_[k], std::memory_order_relaxed);
+                }
+            }
+        }
+
+        ScopedStage(const ScopedStage&) = delete;
+        ScopedStage& operator=(const ScopedStage&) = delete;
+
+    private:
+        Stage stage_;
+        bool active_;
+        PerfCounterGroup* perf_;
+        PerfValues startCounts_;
+        AllocCounts startAllocs_;
+        std::chrono::steady_clock::time_point start_;
+};
+
+// copy of the running totals, to report one run as the difference of two snapshots
+struct StageSnapshot {
+    uint64_t ns[kStages];
+    uint64_t counters[kStages][kPerfEvents];
+    uint64_t allocs[kStages];
+    uint64_t allocBytes[kStages];
+    uint64_t windows;
+};
+
+inline StageSnapshot snapshotStages() {
+    StageSnapshot snap;
+    for (int s = 0; s < kStages; ++s) {
+        snap.ns[s] = stageTotals_.ns[s];
+        snap.allocs[s] = stageTotals_.allocs[s];
+        snap.allocBytes[s] = stageTotals_.allocBytes[s];
+        for (int k = 0; k < kPerfEvents; ++k) snap.counters[s][k] = stageTotals_.counters[s][k];
+    }
+    snap.windows = stageTotals_.windows;
+    return snap;
+}
+
+// per-stage counter table of everything accumulated since 'since' (stages that ran only)
+inline void printStageCounters(std::ostream& out, const StageSnapshot& since) {
+    StageSnapshot now = snapshotStages();
+    out << "  " << std::left << std::setw(20) << "stage" << std::right;
+    for (int k = 0; k < kPerfEvents; ++k) out << std::setw(15) << perfEventName(k);
+    out << std::setw(7) << "IPC" << "\n";
+    for (int s = 0; s < kStages; ++s) {
+        uint64_t d[kPerfEvents];
+        for (int k = 0; k < kPerfEvents; ++k) d[k] = now.counters[s][k] - since.counters[s][k];
+        if (d[PerfCycles] == 0) continue;
+        out << "  " << std::left << std::setw(20) << stageName(static_cast<Stage>(s)) << std::right;
+        for (int k = 0; k < kPerfEvents; ++k) out << std::setw(15) << d[k];
+        out << std::setw(7) << std::fixed << std::setprecision(2) << double(d[PerfInstructions]) / d[PerfCycles]
+            << std::defaultfloat << "\n";
+    }
+}
+
+// per-stage heap traffic since 'since', plus per-window figures for the stages that run per window
+inline void printStageAllocs(std::ostream& out, const StageSnapshot& since) {
+    StageSnapshot now = snapshotStages();
+    double windows = double(now.windows - since.windows);
+    out << "  " << std::left << std::setw(20) << "stage" << std::right << std::setw(14) << "allocs"
+        << std::setw(16) << "bytes" << std::setw(14) << "allocs/win" << std::setw(14) << "bytes/win" << "\n";
+    for (int s = 0; s < kStages; ++s) {
+        uint64_t n = now.allocs[s] - since.allocs[s], b = now.allocBytes[s] - since.allocBytes[s];
+        if (n == 0) continue;
+        Stage st = static_cast<Stage>(s);
+        bool perWindow = st == Stage::WindowSegmentation || st == Stage::KernelBuild || st == Stage::Fitting;
+        out << "  " << std::left << std::setw(20) << stageName(st) << std::right << std::setw(14) << n << std::setw(16) << b;
+        if (perWindow && windows > 0) {
+            out << std::setw(14) << std::fixed << std::setprecision(1) << n / windows << std::setw(14) << b / windows
+                << std::defaultfloat;
+        }
+        out << "\n";
+    }
+}
+
+#endif // STAGE_TIMER_H
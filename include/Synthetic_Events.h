@@ -0,0 +1,41 @@
+#ifndef SYNTHETIC_EVENTS_H
+#define SYNTHETIC_EVENTS_H
+
+#include <cstdint>
+#include <random>
+#include <string>
+#include <vector>
+#include "File_Loader.h" // For EventList
+
+// knobs of one synthetic run; rates are per PMT segment
+struct SyntheticParams {
+    double duration = 300.0; // run length (s); PE background covers [0, duration)
+    double neutronStart = 0.0; // neutron arrivals in [neutronStart, neutronStop) (s)
+    double neutronStop = 300.0;
+    double neutronRate = 50.0; // neutrons per second
+    double peMean = 30.0; // mean light yield (PE) per neutron
+    double peSigma = 10.0; // gaussian spread of the light yield; PE count is Poisson around it
+    double pileupFraction = 0.0; // fraction of neutrons followed by a second one within pileupWindowUs
+    double pileupWindowUs = 20.0;
+    double backgroundRate = 100.0; // uncorrelated single PE per second
+    uint64_t seed = 1;
+};
+
+// generated neutron: arrival time (s) and number of PE it emitted
+struct TruthPulse {
+    double time;
+    int pe;
+};
+
+double samplePEDelay(std::mt19937_64& rng); // one PE arrival delay (us) from the tri-exponential pdfParams_
+
+// four segment streams ("12", "34", "56", "78" order, processfile channels), time-sorted;
+// same seed gives the same events; 'truth' (optional) receives the neutrons per segment
+std::vector<EventList> generateSyntheticRun(const SyntheticParams& p,
+                                            std::vector<std::vector<TruthPulse>>* truth = nullptr);
+
+// "Segment,Time (s),PE" per generated neutron
+bool writeTruthCSV(const std::vector<std::vector<TruthPulse>>& truth,
+                   const std::vector<std::string>& segment_labels, const std::string& path);
+
+#endif // SYNTHETIC_EVENTS_H
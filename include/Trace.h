@@ -0,0 +1,125 @@
+#ifndef TRACE_H
+#define TRACE_H
+
+/**
+ * Scoped tracing with Chrome trace-event export (chrome://tracing, ui.perfetto.dev)
+ *
+ *   TRACE_SCOPE("fitRegion");                         // complete event for the enclosing scope
+ *   TRACE_SCOPE("analysis_setup", {{"run", run}});    // with args (json object)
+ *   TRACE_WRITE(path);                                // dump everything recorded so far
+ *
+ * Compiled in with -DPULSE_TRACE (make TRACE=1). Without it the macros expand to nothing and
+ * their arguments are never evaluated. Events are buffered per thread and merged at thread
+ * exit or TRACE_WRITE, so recording takes no lock.
+ */
+
+#ifdef PULSE_TRACE
+
+#include <atomic>
+#include <chrono>
+#include <fstream>
+#include <iostream>
+#include <mutex>
+#include <string>
+#include <vector>
+#include <json.hpp>
+
+namespace trace {
+
+struct Event {
+    const char* name;
+    nlohmann::json args;
+    double ts; // us since process start
+    double dur; // us
+    int tid;
+};
+
+struct Registry {
+    std::mutex mutex;
+    std::vector<Event> events;
+    std::atomic<int> nextTid{0};
+    std::chrono::steady_clock::time_point t0 = std::chrono::steady_clock::now();
+};
+
+inline Registry registry_;
+
+struct ThreadBuffer {
+    int tid = registry_.nextTid++;
+    std::vector<Event> events;
+
+    void flush() {
+        std::lock_guard<std::mutex> guard(registry_.mutex);
+        registry_.events.insert(registry_.events.end(), std::make_move_iterator(events.begin()),
+                                std::make_move_iterator(events.end()));
+        events.clear();
+    }
+    ~ThreadBuffer() { flush(); }
+};
+
+inline thread_local ThreadBuffer buffer_;
+
+inline double nowUs() {
+    return std::chrono::duration<double, std::micro>(std::chrono::steady_clock::now() - registry_.t0).count();
+}
+
+class Scope {
+    public:
+        explicit Scope(const char* name, nlohmann::json args = nullptr)
+            : name_(name), args_(std::move(args)), start_(nowUs()) {}
+
+        ~Scope() {
+            buffer_.events.push_back({name_, std::move(args_), start_, nowUs() - start_, buffer_.tid});
+        }
+
+        Scope(const Scope&) = delete;
+        Scope& operator=(const Scope&) = delete;
+
+    private:
+        const char* name_;
+        nlohmann::json args_;
+        double start_;
+};
+
+// trace-event JSON of every event flushed so far (plus the calling thread's buffer)
+inline bool write(const std::string& path) {
+    buffer_.flush();
+    std::lock_guard<std::mutex> guard(registry_.mutex);
+    std::ofstream out(path);
+    if (!out.is_open()) {
+        std::cerr << "Error opening trace file: " << path << std::endl;
+        return false;
+    }
+
+    out << "{\"displayTimeUnit\":\"ms\",\"traceEvents\":[\n";
+    int nThreads = registry_.nextTid;
+    for (int t = 0; t < nThreads; ++t) { // tids are assigned in order of first traced scope
+        nlohmann::json meta = {{"ph", "M"}, {"pid", 1}, {"tid", t}, {"name", "thread_name"},
+                               {"args", {{"name", "thread " + std::to_string(t)}}}};
+        out << (t ? ",\n" : "") << meta.dump();
+    }
+    for (const Event& e : registry_.events) {
+        nlohmann::json ev = {{"ph", "X"}, {"pid", 1}, {"tid", e.tid}, {"name", e.name}, {"cat", "pulse"},
+                             {"ts", e.ts}, {"dur", e.dur}};
+        if (!e.args.is_null()) ev["args"] = e.args;
+        out << ",\n" << ev.dump(); // at least one thread_name entry precedes
+    }
+    out << "\n]}\n";
+    std::cout << "Trace (" << registry_.events.size() << " events) written to " << path << std::endl;
+    return true;
+}
+
+} // namespace trace
+
+#define TRACE_CONCAT_(a, b) a##b
+#define TRACE_CONCAT(a, b) TRACE_CONCAT_(a, b)
+#define TRACE_SCOPE(...) trace::Scope TRACE_CONCAT(trace_scope_, __LINE__)(__VA_ARGS__)
+#define TRACE_WRITE(path) trace::write(path)
+
+#else
+
+#define TRACE_SCOPE(...) do {} while (0)
+#define TRACE_WRITE(path) do {} while (0)
+
+#endif // PULSE_TRACE
+
+#endif // TRACE_H
@@ -0,0 +1,50 @@
+#ifndef WINDOW_CORPUS_H
+#define WINDOW_CORPUS_H
+
+#include <cstdint>
+#include <mutex>
+#include <string>
+#include <vector>
+#include <zlib.h>
+
+// one window as fitRegion histogrammed it, ready to be fed back into fitPulses
+struct CorpusWindow {
+    int run;
+    std::string segment; // "12", "34", "56", "78"
+    bool signal; // signal (true) or background window
+    double binWidth; // us (coarse or fine fallback binning)
+    double startTime; // us, absolute
+    std::vector<int> hist;
+};
+
+/**
+ * Replay corpus of production windows: gzip stream, little-endian
+ *
+ *   header   magic "UCNWCOR1", version uint32, reserved uint32
+ *   record   run int32, segment char[4], signal uint8, pad[3], nBins uint32,
+ *            binWidth f8, startTime f8, then nBins x int32 counts
+ *
+ * Opened in append mode: every job adds a gzip member, which gzread handles transparently.
+ * One writer per file (the append is not locked across processes).
+ */
+class Window_Corpus {
+    public:
+        explicit Window_Corpus(const std::string& path); // throws if the file cannot be opened
+        ~Window_Corpus();
+
+        Window_Corpus(const Window_Corpus&) = delete;
+        Window_Corpus& operator=(const Window_Corpus&) = delete;
+
+        void append(int run, const std::string& segment, bool signal, double binWidth,
+                    double startTime, const std::vector<int>& hist);
+        size_t windowsWritten() const { return nWritten_; }
+
+    private:
+        gzFile file_;
+        std::mutex mutex_;
+        size_t nWritten_;
+};
+
+bool readWindowCorpus(const std::string& path, std::vector<CorpusWindow>& windows);
+
+#endif // WINDOW_CORPUS_H
@@ -0,0 +1,54 @@
+"""fit_tau_profiled, the lifetime fit of Calculate_Lifetime.py (native port: src/Lifetime_Fit.cpp)."""
+import numpy as np
+import scipy.optimize as opt
+
+# -----------------------------
+# Lifetime fitting (profile A)
+# -----------------------------
+def fit_tau_profiled(counts_raw, ts):
+    """
+    Fit tau for y_i vs t_i with model A * exp(-t_i/tau),
+    profiling A analytically for each tau.
+
+    counts_raw: array-like of background-corrected, normalized counts (>=0 preferred)
+    ts:         array-like of hold times (seconds)
+    Returns (tau, dtau)
+    """
+    counts = np.asarray(counts_raw, dtype=float) # y_i (background-corrected, normalized)
+    ts = np.asarray(ts, dtype=float)
+    errors = np.sqrt(np.maximum(counts, 1e-9)) # heuristic σ_i after normalization 
+
+    w = 1.0 / (errors**2)
+
+    def chi2_for_tau(tau):
+        if tau <= 0:
+            return np.inf, np.nan
+        m = np.exp(-ts / tau) # model basis for given τ
+        num = np.sum(w * counts * m)
+        den = np.sum(w * m * m)
+        if den <= 0:
+            return np.inf, np.nan
+        Ahat = num / den # profile amplitude analytically
+        chi2 = np.sum(w * (counts - Ahat*m)**2) # χ²(τ) with A=Ahat(τ)
+        return chi2, Ahat
+
+    res = opt.minimize(lambda x: chi2_for_tau(x[0])[0],
+                       x0=np.array([800.0]), method='Powell',
+                       bounds = [(1.0, 1e6)])
+    tau_best = float(res.x[0])
+    chi2_min, _ = chi2_for_tau(tau_best)
+    
+    # Scan around best to get Δχ²=1 band
+    span = max(50.0, 0.15 * tau_best) # scan window around τ*
+    taus = np.linspace(max(1.0, tau_best - span), tau_best + span, 2001)
+    chi2_vals = np.array([chi2_for_tau(tau)[0] for tau in taus])
+    ok = chi2_vals < (np.nanmin(chi2_vals) + 1.0) # Δχ²=1 condition
+    if not np.any(ok):
+        return tau_best, np.nan
+
+    left_idx  = np.argmax(ok)
+    right_idx = len(ok) - np.argmax(ok[::-1]) - 1
+    tau_left, tau_right = taus[left_idx], taus[right_idx]
+    dtau = 0.5 * (tau_right - tau_left)
+
+    return tau_best, dtau
@@ -0,0 +1,55 @@
+// Replacement global allocation functions that feed threadAllocs_ (see Alloc_Tracker.h)
+#include "Alloc_Tracker.h"
+#include <cstdlib>
+#include <new>
+
+namespace {
+
+inline void countAlloc(std::size_t n) {
+    if (allocTracking_.load(std::memory_order_relaxed)) {
+        ++threadAllocs_.allocs;
+        threadAllocs_.bytes += n;
+    }
+}
+
+inline void countFree(void* p) {
+    if (p && allocTracking_.load(std::memory_order_relaxed)) ++threadAllocs_.frees;
+}
+
+void* allocate(std::size_t n) {
+    countAlloc(n);
+    if (void* p = std::malloc(n ? n : 1)) return p;
+    throw std::bad_alloc();
+}
+
+void* allocateAligned(std::size_t n, std::align_val_t align) {
+    countAlloc(n);
+    void* p = nullptr;
+    std::size_t a = static_cast<std::size_t>(align);
+    if (posix_memalign(&p, a < sizeof(void*) ? sizeof(void*) : a, n ? n : 1) != 0) throw std::bad_alloc();
+    return p;
+}
+
+} // namespace
+
+void* operator new(std::size_t n) { return allocate(n); }
+void* operator new[](std::size_t n) { return allocate(n); }
+void* operator new(std::size_t n, const std::nothrow_t&) noexcept {
+    try { return allocate(n); } catch (...) { return nullptr; }
+}
+void* operator new[](std::size_t n, const std::nothrow_t&) noexcept {
+    try { return allocate(n); } catch (...) { return nullptr; }
+}
+void* operator new(std::size_t n, std::align_val_t a) { return allocateAligned(n, a); }
+void* operator new[](std::size_t n, std::align_val_t a) { return allocateAligned(n, a); }
+
+void operator delete(void* p) noexcept { countFree(p); std::free(p); }
+void operator delete[](void* p) noexcept { countFree(p); std::free(p); }
+void operator delete(void* p, std::size_t) noexcept { countFree(p); std::free(p); }
+void operator delete[](void* p, std::size_t) noexcept { countFree(p); std::free(p); }
+void operator delete(void* p, const std::nothrow_t&) noexcept { countFree(p); std::free(p); }
+void operator delete[](void* p, const std::nothrow_t&) noexcept { countFree(p); std::free(p); }
+void operator delete(void* p, std::align_val_t) noexcept { countFree(p); std::free(p); }
+void operator delete[](void* p, std::align_val_t) noexcept { countFree(p); std::free(p); }
+void operator delete(void* p, std::size_t, std::align_val_t) noexcept { countFree(p); std::free(p); }
+void operator delete[](void* p, std::size_t, std::align_val_t) noexcept { countFree(p); std::free(p); }
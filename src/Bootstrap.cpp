@@ -0,0 +1,126 @@
+#include "Bootstrap.h"
+#include "Lifetime_Fit.h"
+#include <algorithm>
+#include <atomic>
+#include <cmath>
+#include <limits>
+#include <map>
+#include <thread>
+
+using namespace std;
+
+array<uint32_t, 4> philox4x32(array<uint32_t, 4> c, array<uint32_t, 2> k) {
+    const uint32_t M0 = 0xD2511F53, M1 = 0xCD9E8D57; // round multipliers
+    const uint32_t W0 = 0x9E3779B9, W1 = 0xBB67AE85; // key schedule (Weyl) constants
+    for (int round = 0; round < 10; ++round) {
+        uint64_t p0 = uint64_t(M0) * c[0];
+        uint64_t p1 = uint64_t(M1) * c[2];
+        c = {uint32_t(p1 >> 32) ^ c[1] ^ k[0], uint32_t(p1),
+             uint32_t(p0 >> 32) ^ c[3] ^ k[1], uint32_t(p0)};
+        k[0] += W0;
+        k[1] += W1;
+    }
+    return c;
+}
+
+namespace {
+
+double percentile(const vector<double>& sorted, double q) {
+    if (sorted.empty()) return numeric_limits<double>::quiet_NaN();
+    double pos = q * (sorted.size() - 1);
+    size_t lo = static_cast<size_t>(pos);
+    size_t hi = min(lo + 1, sorted.size() - 1);
+    return sorted[lo] + (pos - lo) * (sorted[hi] - sorted[lo]);
+}
+
+} // namespace
+
+vector<BootstrapResult> bootstrapLifetime(const vector<RunCounts>& runs, size_t nSegments,
+                                          const vector<int>& thresholds, int nReplicas,
+                                          uint64_t seed, int nThreads)
+{
+    const double nan = numeric_limits<double>::quiet_NaN();
+    const size_t nThresh = thresholds.size();
+
+    // strata: run indices per hold time (sorted by hold)
+    map<int, vector<size_t>> byHold;
+    for (size_t r = 0; r < runs.size(); ++r) byHold[runs[r].hold].push_back(r);
+    vector<int> holds;
+    vector<vector<size_t>> groups;
+    for (auto& kv : byHold) {
+        holds.push_back(kv.first);
+        groups.push_back(move(kv.second));
+    }
+
+    vector<BootstrapResult> results;
+    for (size_t seg = 0; seg < nSegments; ++seg) {
+        for (size_t t = 0; t < nThresh; ++t) {
+            results.push_back({seg, thresholds[t], vector<double>(nReplicas, nan), 0, nan, nan, nan, nan, nan});
+        }
+    }
+
+    const array<uint32_t, 2> key = {uint32_t(seed), uint32_t(seed >> 32)};
+    atomic<int> next(0);
+    auto worker = [&]() {
+        // per-replica sums [hold][segment * nThresh + t], reused across replicas
+        vector<vector<double>> sig(holds.size()), bg(holds.size()), fill(holds.size());
+        vector<vector<uint8_t>> present(holds.size());
+        vector<double> ts, ys;
+        for (int rep = next++; rep < nReplicas; rep = next++) {
+            for (size_t g = 0; g < groups.size(); ++g) {
+                sig[g].assign(nSegments * nThresh, 0.0);
+                bg[g].assign(nSegments * nThresh, 0.0);
+                fill[g].assign(nSegments, 0.0);
+                present[g].assign(nSegments, 0);
+                const vector<size_t>& members = groups[g];
+                for (size_t i = 0; i < members.size(); ++i) {
+                    array<uint32_t, 4> u = philox4x32({uint32_t(i), uint32_t(g), uint32_t(rep), 0}, key);
+                    const RunCounts& rc = runs[members[(uint64_t(u[0]) * members.size()) >> 32]];
+                    for (size_t k = 0; k < sig[g].size(); ++k) {
+                        sig[g][k] += rc.sig[k];
+                        bg[g][k] += rc.bg[k];
+                    }
+                    for (size_t s = 0; s < nSegments; ++s) {
+                        fill[g][s] += rc.fill[s];
+                        present[g][s] |= rc.present[s];
+                    }
+                }
+            }
+
+            for (size_t j = 0; j < results.size(); ++j) {
+                size_t seg = results[j].seg;
+                size_t k = j; // results are laid out [segment][threshold] like the count vectors
+                ts.clear();
+                ys.clear();
+                for (size_t g = 0; g < groups.size(); ++g) {
+                    if (!present[g][seg]) continue; // as counts_per_hold: no run with this segment
+                    ts.push_back(holds[g]);
+                    ys.push_back((sig[g][k] - bg[g][k]) / max(fill[g][seg], 1.0));
+                }
+                if (ts.size() >= 2) results[j].taus[rep] = fitTauProfiled(ys, ts, false).tau;
+            }
+        }
+    };
+
+    vector<thread> pool;
+    for (int k = 0; k < max(nThreads, 1); ++k) pool.emplace_back(worker);
+    for (auto& th : pool) th.join();
+
+    // distribution summaries
+    for (auto& res : results) {
+        vector<double> valid;
+        for (double tau : res.taus) if (!isnan(tau)) valid.push_back(tau);
+        res.nValid = static_cast<int>(valid.size());
+        if (valid.empty()) continue;
+        sort(valid.begin(), valid.end());
+        double sum = 0.0, sumSq = 0.0;
+        for (double tau : valid) sum += tau;
+        res.mean = sum / valid.size();
+        for (double tau : valid) sumSq += (tau - res.mean) * (tau - res.mean);
+        res.stddev = valid.size() > 1 ? sqrt(sumSq / (valid.size() - 1)) : nan;
+        res.p16 = percentile(valid, 0.16);
+        res.p50 = percentile(valid, 0.50);
+        res.p84 = percentile(valid, 0.84);
+    }
+    return results;
+}
@@ -0,0 +1,216 @@
+#include "File_Loader.h"
+#include "Pulse_Output.h"
+#include "PE_Summary.h"
+#include "Result_Store.h"
+#include "Lifetime_Fit.h"
+#include "Bootstrap.h"
+#include <json.hpp>
+#include <algorithm>
+#include <iostream>
+#include <fstream>
+#include <iomanip>
+#include <map>
+#include <memory>
+#include <thread>
+#include <atomic>
+
+using namespace std;
+
+// segment order matches processfile / analysis_setup
+const vector<string> segment_labels = {"12", "34", "56", "78"};
+const vector<string> fill_keys = {"fillUCN12", "fillUCN34", "fillUCN1112", "fillUCN1314"}; // runinfo normalization
+const int threshold_min = 5; // PE thresholds scanned: PE > 5 ... PE > 19
+const int threshold_max = 19;
+
+// PE cube for one run: summary (store or file) if present, otherwise built from the pulse results
+bool load_run_summary(int run, const string& output_folder, Result_Store* store, PESummary& summary) {
+	vector<char> buf;
+	if (store && store->fetch(RecordKind::Summary, run, buf)) {
+		return decodePESummary(buf.data(), buf.size(), summary);
+	}
+	if (readPESummary(output_folder + "summary/PESummary_" + to_string(run) + ".bin", summary)) {
+		return true;
+	}
+
+	RunPulses pulses;
+	int file_run = run;
+	string results = output_folder + "results/PulseAnalysis_" + to_string(run);
+	bool ok = (store && store->fetch(RecordKind::Pulses, run, buf) && decodePulseBinary(buf.data(), buf.size(), pulses, file_run))
+	          || readPulseBinary(results + ".bin", pulses, file_run)
+	          || readPulseCSV(results + ".csv", pulses);
+	if (!ok) return false;
+	// no padding: a segment without CSV rows adds no hold point and no fill, as in Calculate_Lifetime.py
+	summary = buildPESummary(pulses, run);
+	return true;
+}
+
+// threshold counts of one run for the bootstrap (segments in segment_labels order)
+RunCounts run_counts(const PESummary& summary, int hold_t, const json& run_params, const vector<int>& thresholds) {
+	RunCounts rc;
+	rc.hold = hold_t;
+	for (size_t seg = 0; seg < segment_labels.size(); ++seg) {
+		size_t idx = 0;
+		while (idx < summary.labels.size() && summary.labels[idx] != segment_labels[seg]) ++idx;
+		rc.fill.push_back(idx < summary.labels.size() ? run_params.value(fill_keys[seg], 0.0) : 0.0); // as fill_sum
+		rc.present.push_back(idx < summary.labels.size());
+		for (int t : thresholds) {
+			rc.sig.push_back(idx < summary.labels.size() ? summary.countAbove(idx, 1, t) : 0);
+			rc.bg.push_back(idx < summary.labels.size() ? summary.countAbove(idx, 0, t) : 0);
+		}
+	}
+	return rc;
+}
+
+// background-subtracted, fill-normalized counts per hold time for one segment and threshold
+void counts_per_hold(const map<int, PESummary>& cubes, const map<pair<int, size_t>, double>& fill_sum,
+                     size_t seg, double threshold, vector<double>& ts, vector<double>& ys)
+{
+	ts.clear();
+	ys.clear();
+	for (const auto& kv : cubes) { // map order: sorted by hold time
+		const PESummary& cube = kv.second;
+		size_t idx = 0;
+		while (idx < cube.labels.size() && cube.labels[idx] != segment_labels[seg]) ++idx;
+		if (idx == cube.labels.size()) continue;
+
+		double sig_n = cube.countAbove(idx, 1, threshold); // signal window events
+		double bg_n = cube.countAbove(idx, 0, threshold); // background window events (equal 60s windows)
+		auto f = fill_sum.find(make_pair(kv.first, seg));
+		double denom = max(f == fill_sum.end() ? 0.0 : f->second, 1.0);
+		ts.push_back(kv.first);
+		ys.push_back((sig_n - bg_n) / denom);
+	}
+}
+
+int main(int argc, char **argv) {
+	Config cfg;
+	try {
+		cfg = load_config(argc, argv);
+		std::cout << "====================================" << std::endl;
+        std::cout << "Output folder: " << cfg.output_folder << "\n";
+		std::cout << "Runinfo path: "  << cfg.runinfo_path  << "\n";
+		std::cout << "Good runs path: "<< cfg.good_runs_path<< "\n";
+        std::cout << "Start run: "     << cfg.start_run     << "\n";
+        std::cout << "End run: "       << cfg.end_run       << "\n";
+        std::cout << "Result store: "  << (cfg.result_store.empty() ? "(per-run files)" : cfg.result_store) << "\n";
+        std::cout << "Bootstrap replicas: " << cfg.bootstrap_replicas << " (seed " << cfg.bootstrap_seed << ")\n";
+		std::cout << "====================================" << std::endl;
+	} catch (const std::exception& e) {
+		cerr << "Error starting program: " << e.what() << endl;
+		return 1;
+	}
+
+    std::string output_folder = ensureTrailingSlash(cfg.output_folder);
+	json params = cfg.runinfo_json;
+	const std::set<std::string>& good_runs = cfg.good_runs_set;
+
+	unique_ptr<Result_Store> store;
+	if (!cfg.result_store.empty()) {
+		try {
+			store = make_unique<Result_Store>(cfg.result_store);
+		} catch (const std::exception& e) {
+			cerr << "Error opening result store: " << e.what() << endl;
+			return 1;
+		}
+	}
+
+	vector<int> thresholds;
+	for (int t = threshold_min; t <= threshold_max; ++t) thresholds.push_back(t);
+
+	// one pass over runs: sum PE cubes and fill counts per (hold time, segment). Runs come from the
+	// runinfo JSON (good, production, in [start_run, end_run)); Calculate_Lifetime.py reads RUNINFO_CSV
+	map<int, PESummary> cubes; // hold time (s) -> summed cube
+	map<pair<int, size_t>, double> fill_sum;
+	vector<RunCounts> per_run; // kept only for the bootstrap
+	int n_runs = 0;
+	for (int z = cfg.start_run; z < cfg.end_run; z++) {
+		string run = std::to_string(z);
+		if (good_runs.find(run) == good_runs.end()) continue;
+		if (!params.contains(run) || params[run]["run_type"] != "production") continue;
+
+		PESummary summary;
+		if (!load_run_summary(z, output_folder, store.get(), summary)) {
+			cerr << "Missing results for run " << run << ", skipping." << endl;
+			continue;
+		}
+
+		int hold_t = (int)(double)params[run]["hold_time"];
+		if (!cubes[hold_t].add(summary)) {
+			cerr << "PE summary binning differs for run " << run << ", skipping." << endl;
+			continue;
+		}
+		for (size_t seg = 0; seg < segment_labels.size(); ++seg) { // normalize only segments the run has
+			if (find(summary.labels.begin(), summary.labels.end(), segment_labels[seg]) == summary.labels.end()) continue;
+			fill_sum[make_pair(hold_t, seg)] += params[run].value(fill_keys[seg], 0.0);
+		}
+		if (cfg.bootstrap_replicas > 0) per_run.push_back(run_counts(summary, hold_t, params[run], thresholds));
+		n_runs++;
+	}
+	cout << "Runs aggregated: " << n_runs << " over " << cubes.size() << " hold times" << endl;
+
+	// one fit per (segment, threshold), spread over worker threads
+	struct Job { size_t seg; int threshold; TauFit fit; size_t n_holds; };
+	vector<Job> jobs;
+	for (size_t seg = 0; seg < segment_labels.size(); ++seg) {
+		for (int t : thresholds) jobs.push_back({seg, t, {}, 0});
+	}
+
+	int n_threads = cfg.threads > 0 ? cfg.threads : max(1u, thread::hardware_concurrency());
+	atomic<size_t> next(0);
+	auto worker = [&]() {
+		vector<double> ts, ys;
+		for (size_t j = next++; j < jobs.size(); j = next++) {
+			counts_per_hold(cubes, fill_sum, jobs[j].seg, jobs[j].threshold, ts, ys);
+			jobs[j].n_holds = ts.size();
+			if (ts.size() >= 2) jobs[j].fit = fitTauProfiled(ys, ts);
+		}
+	};
+	vector<thread> pool;
+	for (int k = 0; k < n_threads; ++k) pool.emplace_back(worker);
+	for (auto& th : pool) th.join();
+
+	string table_path = output_folder + "results/lifetime_vs_threshold.csv";
+	ofstream out(table_path);
+	if (!out.is_open()) {
+		cerr << "Error opening output file: " << table_path << endl;
+		return 1;
+	}
+	out << "Segment,Threshold,Tau,dTau,Amplitude,Chi2,nHold\n"; // dTau in s, not the plot's dtau / 10000
+	out << setprecision(10);
+	for (const auto& job : jobs) {
+		out << segment_labels[job.seg] << "," << job.threshold << ",";
+		if (job.n_holds >= 2) {
+			out << job.fit.tau << "," << job.fit.dtau << "," << job.fit.amplitude << "," << job.fit.chi2;
+		} else {
+			out << "nan,nan,nan,nan"; // fewer than two hold times
+		}
+		out << "," << job.n_holds << "\n";
+	}
+	cout << "Lifetime table written to " << table_path << endl;
+	out.close();
+
+	if (cfg.bootstrap_replicas > 0) {
+		// tau distributions from resampling runs; reproducible for any thread count
+		vector<BootstrapResult> boot = bootstrapLifetime(per_run, segment_labels.size(), thresholds,
+		                                                 cfg.bootstrap_replicas, cfg.bootstrap_seed, n_threads);
+
+		string boot_path = output_folder + "results/lifetime_bootstrap.csv";
+		string samples_path = output_folder + "results/lifetime_bootstrap_samples.csv";
+		ofstream bout(boot_path), sout(samples_path);
+		if (!bout.is_open() || !sout.is_open()) {
+			cerr << "Error opening bootstrap output in " << output_folder << "results/" << endl;
+			return 1;
+		}
+		bout << "Segment,Threshold,Replicas,Valid,Mean,Std,P16,P50,P84\n" << setprecision(10);
+		sout << "Segment,Threshold,Replica,Tau\n" << setprecision(10);
+		for (const auto& res : boot) {
+			bout << segment_labels[res.seg] << "," << res.threshold << "," << res.taus.size() << "," << res.nValid << ","
+			     << res.mean << "," << res.stddev << "," << res.p16 << "," << res.p50 << "," << res.p84 << "\n";
+			for (size_t r = 0; r < res.taus.size(); ++r) {
+				sout << segment_labels[res.seg] << "," << res.threshold << "," << r << "," << res.taus[r] << "\n";
+			}
+		}
+		cout << "Bootstrap summary written to " << boot_path << endl;
+	}
+	return 0;
+}
@@ -1,4 +1,6 @@
 #include "File_Loader.h"
+#include "Stage_Timer.h"
+#include "Trace.h"
 #include <json.hpp>
 #include <stdexcept>
 #include <TFile.h>
@@ -20,6 +22,7 @@ string ensureTrailingSlash(const string& folder) {
 
 // process ROOT filename for this run and return PE timestamps for each PMT pair
 vector<EventList> processfile(string data_folder, string runnum) {
+	TRACE_SCOPE("processfile", {{"run", runnum}});
 	
 	// build ROOT filename (import) for this run
 	string part1 = "processed_output_";
@@ -40,7 +43,23 @@ vector<EventList> processfile(string data_folder, string runnum) {
         return {};
     } 
     
-	// open file and fetch trees
+	// route channels into segment lists: (1,2)->12, (3,4)->34, (11,12)->1112, (13,14)->1314
+    EventList PMT12, PMT34, PMT1112, PMT1314;
+	auto route0 = [&](const event& evt0) {
+		if (evt0.channel == 1 or evt0.channel == 2) {PMT12.push_back(evt0);}
+		else if (evt0.channel == 3 or evt0.channel == 4) {PMT34.push_back(evt0);}
+	};
+	auto route1 = [&](const event& evt1) {
+		if (evt1.channel == 11 or evt1.channel == 12) {PMT1112.push_back(evt1);}
+		else if (evt1.channel == 13 or evt1.channel == 14) {PMT1314.push_back(evt1);}
+	};
+
+	// open file and read both boards; benchmark mode buffers them so that loading and routing are
+	// timed apart, otherwise entries are routed as they are read (no second copy of the run)
+	bool split_timing = stageTotals_.enabled;
+	vector<event> board0, board1;
+	{
+	ScopedStage load_timer(Stage::RootLoad);
     TFile* fin = TFile::Open(filename.c_str());	
     TTree* tmcs_0 = (TTree*)fin->Get("tmcs_0");
     TTree* tmcs_1 = (TTree*)fin->Get("tmcs_1");
@@ -65,8 +84,6 @@ vector<EventList> processfile(string data_folder, string runnum) {
 	cout << runnum << " final run duration = " << run_duration << endl;
 	*/
 
-	// accumulate events into 4 segment lists
-    EventList PMT12, PMT34, PMT1112, PMT1314;
     event evt0;
     tmcs_0->SetBranchAddress("channel",&evt0.channel);
     tmcs_0->SetBranchAddress("edge",&evt0.edge);
@@ -83,19 +100,22 @@ vector<EventList> processfile(string data_folder, string runnum) {
     tmcs_1->SetBranchAddress("time",&evt1.time);
     tmcs_1->SetBranchAddress("realtime",&evt1.realtime);
     
-    // route channels into segment lists: (1,2)->12, (3,4)->34, (11,12)->1112, (13,14)->1314
-    for (long i=0; i<tmcs_0->GetEntries();tmcs_0->GetEntry(i++))
-    {
-		if (evt0.channel == 1 or evt0.channel == 2) {PMT12.push_back(evt0);}
-		else if (evt0.channel == 3 or evt0.channel == 4) {PMT34.push_back(evt0);}
-
+    if (split_timing) {
+        board0.reserve(tmcs_0->GetEntries());
+        for (long i=0; i<tmcs_0->GetEntries();tmcs_0->GetEntry(i++)) board0.push_back(evt0);
+        board1.reserve(tmcs_1->GetEntries());
+        for (long j=0; j<tmcs_1->GetEntries();tmcs_1->GetEntry(j++)) board1.push_back(evt1);
+    } else {
+        for (long i=0; i<tmcs_0->GetEntries();tmcs_0->GetEntry(i++)) route0(evt0);
+        for (long j=0; j<tmcs_1->GetEntries();tmcs_1->GetEntry(j++)) route1(evt1);
     }
+	}
 
-    for (long j=0; j<tmcs_1->GetEntries();tmcs_1->GetEntry(j++))
-    {
-        if (evt1.channel == 11 or evt1.channel == 12) {PMT1112.push_back(evt1);}
-		else if (evt1.channel == 13 or evt1.channel == 14) {PMT1314.push_back(evt1);}
-    }
+	if (split_timing) {
+		ScopedStage route_timer(Stage::ChannelRouting);
+		for (const event& evt0 : board0) route0(evt0);
+		for (const event& evt1 : board1) route1(evt1);
+	}
 
 	// bundle into vector in fixed segment order
 	vector<EventList> result;
@@ -200,6 +220,30 @@ Config load_config(int argc, char** argv, const std::string& default_cfg) {
     c.start_run = cfg.value("start_run", 0);
     c.end_run = cfg.value("end_run", 0);
     c.save_to_txt = cfg.value("save_to_txt", false);
+    c.output_format = cfg.value("output_format", "csv");
+    c.compress_output = cfg.value("compress_output", false);
+    c.result_store = cfg.value("result_store", "");
+    c.pe_summary = cfg.value("pe_summary", false);
+    c.threads = cfg.value("threads", 0);
+    c.bootstrap_replicas = cfg.value("bootstrap_replicas", 0);
+    c.bootstrap_seed = cfg.value("bootstrap_seed", uint64_t(12345));
+    c.benchmark = cfg.value("benchmark", false);
+    c.perf_counters = cfg.value("perf_counters", false);
+    c.alloc_tracking = cfg.value("alloc_tracking", false);
+    c.fit_telemetry = cfg.value("fit_telemetry", false);
+    c.kernel_tolerance = cfg.value("kernel_tolerance", 0.0);
+    c.recursive_kernel = cfg.value("recursive_kernel", false);
+    c.incremental_likelihood = cfg.value("incremental_likelihood", false);
+    c.fit_memo_mb = cfg.value("fit_memo_mb", 0.0);
+    c.fit_memo_file = cfg.value("fit_memo_file", "");
+    c.fit_memo_max_bins = cfg.value("fit_memo_max_bins", 16);
+    c.fit_table = cfg.value("fit_table", "");
+    c.window_triage = cfg.value("window_triage", false);
+    c.split_window_bins = cfg.value("split_window_bins", 0);
+    c.window_corpus = cfg.value("window_corpus", "");
+    if (c.output_format != "csv" && c.output_format != "binary") {
+        throw std::runtime_error("Unknown output_format (expected csv or binary): " + c.output_format);
+    }
 
 	// load runinfo JSON
     {
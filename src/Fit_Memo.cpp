@@ -0,0 +1,162 @@
+#include "Fit_Memo.h"
+#include <cstring>
+#include <iostream>
+#include <zlib.h>
+
+using namespace std;
+
+namespace {
+
+const char kMemoMagic[8] = {'U', 'C', 'N', 'F', 'M', 'E', 'M', '1'};
+const uint32_t kMemoVersion = 2; // 2: flags byte carries maxeval
+
+struct MemoHeader {
+    char magic[8];
+    uint32_t version;
+    uint32_t reserved;
+};
+
+static_assert(sizeof(MemoHeader) == 16, "memo header layout is part of the file format");
+
+bool gzReadAll(gzFile f, void* buf, size_t n) {
+    return n == 0 || gzread(f, buf, static_cast<unsigned>(n)) == static_cast<int>(n);
+}
+
+template <typename T>
+bool gzReadValue(gzFile f, T& v) {
+    return gzReadAll(f, &v, sizeof(T));
+}
+
+template <typename T>
+void gzWriteValue(gzFile f, const T& v) {
+    gzwrite(f, &v, sizeof(T));
+}
+
+} // namespace
+
+Fit_Memo::Fit_Memo(size_t budgetBytes, int maxBins) : budget_(budgetBytes), maxBins_(maxBins) {}
+
+size_t Fit_Memo::entryBytes(const string& key, const MemoFit& fit) {
+    // key and results plus list node, hash node and vector headers (approximate)
+    return key.size() + (fit.pe.size() + fit.dt.size()) * sizeof(double) + 160;
+}
+
+Fit_Memo::Stats Fit_Memo::stats() const {
+    lock_guard<mutex> guard(mutex_);
+    return {lookups_, hits_, evictions_, index_.size(), bytes_};
+}
+
+bool Fit_Memo::lookup(const string& key, MemoFit& fit) {
+    lock_guard<mutex> guard(mutex_);
+    ++lookups_;
+    auto it = index_.find(key);
+    if (it == index_.end()) return false;
+    ++hits_;
+    lru_.splice(lru_.begin(), lru_, it->second); // now most recently used
+    const MemoFit& cached = it->second->second;
+    fit.fitted = cached.fitted;
+    fit.pe.assign(cached.pe.begin(), cached.pe.end());
+    fit.dt.assign(cached.dt.begin(), cached.dt.end());
+    fit.nll = cached.nll;
+    fit.stats = cached.stats;
+    return true;
+}
+
+void Fit_Memo::insert(const string& key, const MemoFit& fit) {
+    lock_guard<mutex> guard(mutex_);
+    insertLocked(key, fit);
+}
+
+void Fit_Memo::insertLocked(const string& key, const MemoFit& fit) {
+    if (index_.count(key)) return; // another fitter got there first: same result
+    size_t size = entryBytes(key, fit);
+    if (size > budget_) return;
+    while (bytes_ + size > budget_ && !lru_.empty()) {
+        bytes_ -= entryBytes(lru_.back().first, lru_.back().second);
+        index_.erase(lru_.back().first);
+        lru_.pop_back();
+        ++evictions_;
+    }
+    lru_.emplace_front(key, fit);
+    index_[key] = lru_.begin();
+    bytes_ += size;
+}
+
+bool Fit_Memo::load(const string& path) {
+    gzFile f = gzopen(path.c_str(), "rb");
+    if (!f) {
+        cerr << "Error opening fit memo: " << path << endl;
+        return false;
+    }
+
+    MemoHeader h;
+    if (!gzReadAll(f, &h, sizeof(h)) || memcmp(h.magic, kMemoMagic, sizeof(kMemoMagic)) != 0
+        || h.version != kMemoVersion) {
+        cerr << "Not a fit memo (or an older version): " << path << endl;
+        gzclose(f);
+        return false;
+    }
+
+    lock_guard<mutex> guard(mutex_);
+    uint32_t keyLen;
+    size_t loaded = 0;
+    while (gzReadValue(f, keyLen)) {
+        string key(keyLen, '\0');
+        MemoFit fit;
+        uint8_t fitted, flags;
+        uint32_t n;
+        int32_t seeds, pulses, result;
+        bool ok = gzReadAll(f, &key[0], keyLen) && gzReadValue(f, fitted) && gzReadValue(f, n);
+        if (ok) {
+            fit.pe.resize(n);
+            fit.dt.resize(n);
+            ok = gzReadAll(f, fit.pe.data(), n * sizeof(double)) && gzReadAll(f, fit.dt.data(), n * sizeof(double))
+                 && gzReadValue(f, fit.nll) && gzReadValue(f, seeds) && gzReadValue(f, pulses)
+                 && gzReadValue(f, result) && gzReadValue(f, flags);
+        }
+        if (!ok) {
+            cerr << "Fit memo " << path << ": truncated entry after " << loaded << " entries" << endl;
+            break;
+        }
+        fit.fitted = fitted != 0;
+        fit.stats = {seeds, pulses, result, (flags & 1) != 0, (flags & 2) != 0};
+        insertLocked(key, fit);
+        ++loaded;
+    }
+    gzclose(f);
+    return true;
+}
+
+bool Fit_Memo::save(const string& path) const {
+    gzFile f = gzopen(path.c_str(), "wb1");
+    if (!f) {
+        cerr << "Error opening fit memo for writing: " << path << endl;
+        return false;
+    }
+
+    MemoHeader h = {};
+    memcpy(h.magic, kMemoMagic, sizeof(kMemoMagic));
+    h.version = kMemoVersion;
+    gzwrite(f, &h, sizeof(h));
+
+    lock_guard<mutex> guard(mutex_);
+    for (auto it = lru_.rbegin(); it != lru_.rend(); ++it) { // least recent first: load() restores the order
+        const auto& entry = *it;
+        const string& key = entry.first;
+        const MemoFit& fit = entry.second;
+        gzWriteValue(f, static_cast<uint32_t>(key.size()));
+        gzwrite(f, key.data(), static_cast<unsigned>(key.size()));
+        gzWriteValue(f, static_cast<uint8_t>(fit.fitted));
+        gzWriteValue(f, static_cast<uint32_t>(fit.pe.size()));
+        if (!fit.pe.empty()) {
+            gzwrite(f, fit.pe.data(), static_cast<unsigned>(fit.pe.size() * sizeof(double)));
+            gzwrite(f, fit.dt.data(), static_cast<unsigned>(fit.dt.size() * sizeof(double)));
+        }
+        gzWriteValue(f, fit.nll);
+        gzWriteValue(f, static_cast<int32_t>(fit.stats.seeds));
+        gzWriteValue(f, static_cast<int32_t>(fit.stats.pulses));
+        gzWriteValue(f, static_cast<int32_t>(fit.stats.result));
+        gzWriteValue(f, static_cast<uint8_t>(fit.stats.refit | fit.stats.maxeval << 1));
+    }
+    return gzclose(f) == Z_OK;
+}
@@ -0,0 +1,261 @@
+#include "Fit_Table.h"
+#include "Pulse_Fitting.h"
+#include <chrono>
+#include <cmath>
+#include <cstring>
+#include <iostream>
+#include <zlib.h>
+
+using namespace std;
+
+namespace {
+
+const char kTableMagic[8] = {'U', 'C', 'N', 'F', 'T', 'A', 'B', '1'};
+const uint32_t kTableVersion = 2; // 2: flags byte carries maxeval
+
+struct TableHeader {
+    char magic[8];
+    uint32_t version;
+    uint32_t fitVersion;
+    PDFParams pdf;
+    uint32_t maxBins;
+    uint32_t maxCounts;
+    uint32_t nBinWidths;
+    uint32_t reserved;
+};
+
+static_assert(sizeof(TableHeader) == 16 + sizeof(PDFParams) + 16, "table header layout is part of the file format");
+
+bool gzReadAll(gzFile f, void* buf, size_t n) {
+    // gzread takes an unsigned count: read large record blocks in pieces
+    char* p = static_cast<char*>(buf);
+    while (n > 0) {
+        unsigned chunk = static_cast<unsigned>(min<size_t>(n, 1u << 30));
+        if (gzread(f, p, chunk) != static_cast<int>(chunk)) return false;
+        p += chunk;
+        n -= chunk;
+    }
+    return true;
+}
+
+const double kMaxRecords = 1 << 24; // 1.3 GB of records: well past any useful table
+
+double recordsPerWidth(int maxBins, int maxCounts) {
+    // vectors of n bins with sum <= maxCounts: C(maxCounts + n, n); in double, to vet sizes before layout()
+    double total = 0.0;
+    for (int n = 2; n <= maxBins; ++n) {
+        total += exp(lgamma(maxCounts + n + 1.0) - lgamma(n + 1.0) - lgamma(maxCounts + 1.0));
+    }
+    return total;
+}
+
+} // namespace
+
+void Fit_Table::layout() {
+    int top = maxCounts_ + maxBins_;
+    binom_.assign(top + 1, vector<uint64_t>(maxBins_ + 1, 0));
+    for (int a = 0; a <= top; ++a) {
+        binom_[a][0] = 1;
+        for (int b = 1; b <= min(a, maxBins_); ++b) {
+            binom_[a][b] = binom_[a - 1][b - 1] + (b <= a - 1 ? binom_[a - 1][b] : 0);
+        }
+    }
+
+    offset_.assign(binWidths_.size() * (maxBins_ + 1) + 1, 0);
+    size_t total = 0;
+    for (size_t w = 0; w < binWidths_.size(); ++w) {
+        for (int n = 0; n <= maxBins_; ++n) {
+            offset_[w * (maxBins_ + 1) + n] = total;
+            if (n >= 2) total += count(n, maxCounts_);
+        }
+    }
+    offset_.back() = total;
+}
+
+int64_t Fit_Table::rank(const vector<int>& hist) const {
+    // lexicographic position among all vectors of this length with sum <= maxCounts_
+    int n = static_cast<int>(hist.size());
+    int budget = maxCounts_;
+    uint64_t r = 0;
+    for (int i = 0; i < n; ++i) {
+        int h = hist[i];
+        if (h < 0 || h > budget) return -1;
+        for (int v = 0; v < h; ++v) r += count(n - i - 1, budget - v);
+        budget -= h;
+    }
+    return static_cast<int64_t>(r);
+}
+
+bool Fit_Table::lookup(const vector<int>& hist, double binWidth, MemoFit& fit) const {
+    ++lookups_;
+    int n = static_cast<int>(hist.size());
+    if (n < 2 || n > maxBins_) return false;
+    size_t w = 0;
+    while (w < binWidths_.size() && binWidths_[w] != binWidth) ++w;
+    if (w == binWidths_.size()) return false;
+    int64_t r = rank(hist);
+    if (r < 0) return false;
+
+    const Record& rec = records_[offset_[w * (maxBins_ + 1) + n] + r];
+    if (rec.status == 2) return false;
+    fit.fitted = rec.status == 1;
+    fit.pe.assign(rec.pe, rec.pe + (fit.fitted ? rec.nPulses : 0));
+    fit.dt.assign(rec.dt, rec.dt + (fit.fitted ? rec.nPulses : 0));
+    fit.nll = rec.nll;
+    fit.stats = {rec.seeds, rec.nPulses, rec.result, (rec.flags & 1) != 0, (rec.flags & 2) != 0};
+    ++hits_;
+    return true;
+}
+
+bool Fit_Table::build(Pulse_Fitting& fitter, int maxBins, int maxCounts, bool verbose) {
+    if (maxBins < 2 || maxCounts < 0 || 2 * recordsPerWidth(maxBins, maxCounts) > kMaxRecords) {
+        cerr << "Fit table needs maxBins >= 2, maxCounts >= 0 and at most " << kMaxRecords << " windows" << endl;
+        return false;
+    }
+    maxBins_ = maxBins;
+    maxCounts_ = maxCounts;
+    binWidths_ = {fitter.binWidth_, fitter.fineBinWidth_};
+    layout();
+    records_.assign(offset_.back(), Record());
+
+    // the exact, non-incremental kernel only: fitPulses consults the table only under those settings
+    fitter.setKernelTolerance(0.0);
+    fitter.setRecursiveKernel(false);
+    fitter.setIncrementalLikelihood(false);
+    fitter.setFitMemo(nullptr);
+    fitter.setFitTable(nullptr);
+
+    vector<int> hist;
+    vector<double> xCenters, fittedPEs, fittedDTs;
+    double fitNLL;
+    for (size_t w = 0; w < binWidths_.size(); ++w) {
+        for (int n = 2; n <= maxBins_; ++n) {
+            auto start = chrono::steady_clock::now();
+            xCenters.resize(n);
+            for (int b = 0; b < n; ++b) xCenters[b] = b * binWidths_[w]; // as makeHistogram
+            const vector<vector<double>>& pdfLookup = fitter.generatePDFLookup(xCenters);
+
+            // lexicographic enumeration: the i-th histogram visited has rank i
+            size_t first = offset_[w * (maxBins_ + 1) + n];
+            size_t count = offset_[w * (maxBins_ + 1) + n + 1] - first;
+            hist.assign(n, 0);
+            for (size_t i = 0; i < count; ++i) {
+                Record& rec = records_[first + i];
+                bool fitted = fitter.solvePulses(hist, xCenters, pdfLookup, fittedPEs, fittedDTs, fitNLL);
+                const WindowFitStats& stats = fitter.lastFit_;
+                rec = Record();
+                if (fitted && fittedPEs.size() > static_cast<size_t>(kMaxPulses)) {
+                    rec.status = 2;
+                } else {
+                    rec.status = fitted ? 1 : 0;
+                    rec.nPulses = static_cast<uint8_t>(stats.pulses);
+                    rec.seeds = static_cast<uint8_t>(stats.seeds);
+                    rec.flags = static_cast<uint8_t>(stats.refit | stats.maxeval << 1);
+                    rec.result = stats.result;
+                    rec.nll = fitNLL;
+                    if (fitted) {
+                        for (size_t k = 0; k < fittedPEs.size(); ++k) {
+                            rec.pe[k] = fittedPEs[k];
+                            rec.dt[k] = fittedDTs[k];
+                        }
+                    }
+                }
+
+                // successor: bump the last bin while there is budget, else carry the last nonzero bin left
+                int used = 0, last = -1;
+                for (int b = 0; b < n; ++b) {
+                    used += hist[b];
+                    if (hist[b]) last = b;
+                }
+                if (used < maxCounts_) {
+                    ++hist[n - 1];
+                } else if (last > 0) {
+                    hist[last] = 0;
+                    ++hist[last - 1];
+                }
+            }
+
+            if (verbose) {
+                double s = chrono::duration<double>(chrono::steady_clock::now() - start).count();
+                cout << "binWidth " << binWidths_[w] << " us, " << n << " bins: " << count << " windows in "
+                     << s << " s" << endl;
+            }
+        }
+    }
+    fitter.pdfCache_.clear();
+    return true;
+}
+
+bool Fit_Table::save(const string& path) const {
+    gzFile f = gzopen(path.c_str(), "wb6");
+    if (!f) {
+        cerr << "Error opening fit table for writing: " << path << endl;
+        return false;
+    }
+
+    TableHeader h = {};
+    memcpy(h.magic, kTableMagic, sizeof(kTableMagic));
+    h.version = kTableVersion;
+    h.fitVersion = Pulse_Fitting::kFitVersion;
+    h.pdf = pdfParams_;
+    h.maxBins = maxBins_;
+    h.maxCounts = maxCounts_;
+    h.nBinWidths = static_cast<uint32_t>(binWidths_.size());
+    gzwrite(f, &h, sizeof(h));
+    gzwrite(f, binWidths_.data(), static_cast<unsigned>(binWidths_.size() * sizeof(double)));
+    const char* p = reinterpret_cast<const char*>(records_.data());
+    size_t n = records_.size() * sizeof(Record);
+    while (n > 0) {
+        unsigned chunk = static_cast<unsigned>(min<size_t>(n, 1u << 30));
+        gzwrite(f, p, chunk);
+        p += chunk;
+        n -= chunk;
+    }
+    return gzclose(f) == Z_OK;
+}
+
+bool Fit_Table::load(const string& path) {
+    gzFile f = gzopen(path.c_str(), "rb");
+    if (!f) {
+        cerr << "Error opening fit table: " << path << endl;
+        return false;
+    }
+
+    TableHeader h;
+    if (!gzReadAll(f, &h, sizeof(h)) || memcmp(h.magic, kTableMagic, sizeof(kTableMagic)) != 0
+        || h.version != kTableVersion) {
+        cerr << "Not a fit table (or an older version): " << path << endl;
+        gzclose(f);
+        return false;
+    }
+    if (h.fitVersion != Pulse_Fitting::kFitVersion || memcmp(&h.pdf, &pdfParams_, sizeof(PDFParams)) != 0) {
+        cerr << "Fit table " << path << " was built for another fit version or PDF parameters; "
+             << "regenerate it with Make_Fit_Table" << endl;
+        gzclose(f);
+        return false;
+    }
+    if (h.maxBins < 2 || h.maxBins > 1024 || h.maxCounts > (1u << 20) || h.nBinWidths == 0 || h.nBinWidths > 16
+        || h.nBinWidths * recordsPerWidth(h.maxBins, h.maxCounts) > kMaxRecords) {
+        cerr << "Fit table " << path << ": implausible header" << endl;
+        gzclose(f);
+        return false;
+    }
+
+    maxBins_ = static_cast<int>(h.maxBins);
+    maxCounts_ = static_cast<int>(h.maxCounts);
+    binWidths_.resize(h.nBinWidths);
+    bool ok = gzReadAll(f, binWidths_.data(), binWidths_.size() * sizeof(double));
+    if (ok) {
+        layout();
+        records_.resize(offset_.back());
+        ok = gzReadAll(f, records_.data(), records_.size() * sizeof(Record));
+    }
+    gzclose(f);
+    if (!ok) {
+        cerr << "Fit table " << path << ": truncated" << endl;
+        records_.clear();
+        maxBins_ = 0; // lookups miss
+        return false;
+    }
+    return true;
+}
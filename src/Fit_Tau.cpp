@@ -0,0 +1,50 @@
+// Runs fitTauProfiled on every series of a CSV (series,t,y rows, header line first) and prints
+// series,tau,dtau,amplitude,chi2 -- the native side of check_lifetime_fit.py.
+// Usage: Fit_Tau <fixture.csv>
+#include "Lifetime_Fit.h"
+#include <fstream>
+#include <iomanip>
+#include <iostream>
+#include <map>
+#include <sstream>
+#include <string>
+#include <vector>
+
+using namespace std;
+
+int main(int argc, char **argv) {
+    if (argc != 2) {
+        cerr << "Usage: Fit_Tau <fixture.csv>" << endl;
+        return 1;
+    }
+    ifstream in(argv[1]);
+    if (!in) {
+        cerr << "Error: cannot open " << argv[1] << endl;
+        return 1;
+    }
+
+    map<string, pair<vector<double>, vector<double>>> series; // name -> (t, y)
+    vector<string> order;
+    string line;
+    getline(in, line); // header
+    while (getline(in, line)) {
+        if (line.empty()) continue;
+        stringstream ss(line);
+        string name, t, y;
+        if (!getline(ss, name, ',') || !getline(ss, t, ',') || !getline(ss, y, ',')) {
+            cerr << "Error: bad fixture line: " << line << endl;
+            return 1;
+        }
+        if (!series.count(name)) order.push_back(name);
+        series[name].first.push_back(stod(t));
+        series[name].second.push_back(stod(y));
+    }
+
+    cout << "series,tau,dtau,amplitude,chi2" << endl << setprecision(12);
+    for (const string& name : order) {
+        const auto& s = series[name];
+        TauFit fit = fitTauProfiled(s.second, s.first);
+        cout << name << ',' << fit.tau << ',' << fit.dtau << ',' << fit.amplitude << ',' << fit.chi2 << endl;
+    }
+    return 0;
+}
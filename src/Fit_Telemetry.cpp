@@ -0,0 +1,96 @@
+#include "Fit_Telemetry.h"
+#include <algorithm>
+#include <cmath>
+#include <iomanip>
+#include <iostream>
+#include <stdexcept>
+
+using namespace std;
+using json = nlohmann::json;
+
+Fit_Telemetry::Fit_Telemetry(int run, const string& csvPath)
+    : run_(run), csv_(csvPath), evalHist_(kEvalBins, 0)
+{
+    if (!csv_.is_open()) throw runtime_error("Cannot open fit telemetry file " + csvPath);
+    csv_ << "Segment,Region,Start (us),nBins,BinWidth (us),Seeds,Pulses,Evals,Result,Refit,MaxEval,KernelFallback,MemoHit,TableHit,Fit (us)\n";
+    csv_ << setprecision(15);
+}
+
+void Fit_Telemetry::record(const WindowFitRecord& w) {
+    lock_guard<mutex> guard(mutex_);
+    csv_ << w.segment << "," << (w.signal ? "signal" : "background") << "," << w.startTime << ","
+         << w.nBins << "," << w.binWidth << "," << w.stats.seeds << "," << w.stats.pulses << ","
+         << w.evals << "," << w.stats.result << "," << (w.stats.refit ? 1 : 0) << ","
+         << (w.stats.maxeval ? 1 : 0) << "," << (w.stats.kernelFallback ? 1 : 0) << ","
+         << (w.stats.memoHit ? 1 : 0) << "," << (w.stats.tableHit ? 1 : 0) << "," << w.fitUs << "\n";
+
+    ++nWindows_;
+    nMemoHits_ += w.stats.memoHit;
+    nTableHits_ += w.stats.tableHit;
+    totalFitUs_ += w.fitUs;
+    if (!w.stats.memoHit && !w.stats.tableHit) { // solver statistics: a hit ran no solve (0 evaluations)
+        nRefits_ += w.stats.refit;
+        nMaxEval_ += w.stats.maxeval; // also when the refit then converged: result only holds the last solve
+        nKernelFallbacks_ += w.stats.kernelFallback;
+        evalHist_[min<long>(w.evals / kEvalBinWidth, kEvalBins - 1)]++;
+        resultCounts_[w.stats.result]++;
+    }
+    pulseCounts_[w.stats.pulses]++;
+    fitTimeLog2_[w.fitUs >= 1.0 ? static_cast<int>(floor(log2(w.fitUs))) : 0]++;
+
+    if (slowest_.size() < kSlowest) {
+        slowest_.push_back(w);
+    } else {
+        auto fastest = min_element(slowest_.begin(), slowest_.end(),
+                                   [](const WindowFitRecord& a, const WindowFitRecord& b) { return a.fitUs < b.fitUs; });
+        if (w.fitUs > fastest->fitUs) *fastest = w;
+    }
+}
+
+json Fit_Telemetry::summary() const {
+    lock_guard<mutex> guard(mutex_);
+    json s;
+    s["run"] = run_;
+    s["windows"] = nWindows_;
+    s["refits"] = nRefits_;
+    s["maxeval_reached"] = nMaxEval_;
+    s["kernel_fallbacks"] = nKernelFallbacks_;
+    s["memo_hits"] = nMemoHits_;
+    s["table_hits"] = nTableHits_;
+    s["fit_us_total"] = totalFitUs_;
+    s["fit_us_mean"] = nWindows_ ? totalFitUs_ / nWindows_ : 0.0;
+
+    json evals = json::array();
+    for (int b = 0; b < kEvalBins; ++b) {
+        evals.push_back({{"lo", b * kEvalBinWidth}, {"windows", evalHist_[b]}}); // last bin open-ended
+    }
+    s["evals_hist"] = evals;
+
+    json results = json::object(), pulses = json::object(), times = json::object();
+    for (const auto& kv : resultCounts_) results[to_string(kv.first)] = kv.second;
+    for (const auto& kv : pulseCounts_) pulses[to_string(kv.first)] = kv.second;
+    for (const auto& kv : fitTimeLog2_) times[to_string(1L << kv.first)] = kv.second; // lower edge (us)
+    s["result_codes"] = results;
+    s["pulses_hist"] = pulses;
+    s["fit_us_log2_hist"] = times;
+
+    vector<WindowFitRecord> slow = slowest_;
+    sort(slow.begin(), slow.end(), [](const WindowFitRecord& a, const WindowFitRecord& b) { return a.fitUs > b.fitUs; });
+    json worst = json::array();
+    for (const auto& w : slow) {
+        worst.push_back({{"segment", w.segment}, {"signal", w.signal}, {"start_us", w.startTime}, {"nBins", w.nBins},
+                         {"seeds", w.stats.seeds}, {"evals", w.evals}, {"result", w.stats.result}, {"fit_us", w.fitUs}});
+    }
+    s["slowest"] = worst;
+    return s;
+}
+
+bool Fit_Telemetry::writeSummary(const string& path) const {
+    ofstream out(path);
+    if (!out.is_open()) {
+        cerr << "Error opening fit telemetry summary: " << path << endl;
+        return false;
+    }
+    out << summary().dump(2) << endl;
+    return true;
+}
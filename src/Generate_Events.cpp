@@ -0,0 +1,134 @@
+// Synthetic runs for load and accuracy testing without experiment data.
+// Writes processed_output_<run>.root (tmcs_0/tmcs_1/tems, as read by processfile), truth_<run>.csv,
+// and a runinfo/good-runs pair so Pulse_Analysis and Calculate_Lifetime can run on the result.
+// Usage: Generate_Events [synthetic_config.json]
+#include "File_Loader.h"
+#include "Synthetic_Events.h"
+#include <json.hpp>
+#include <TFile.h>
+#include <TTree.h>
+#include <cmath>
+#include <fstream>
+#include <iostream>
+#include <memory>
+
+using namespace std;
+
+const vector<string> segment_labels = {"12", "34", "56", "78"};
+const vector<string> fill_keys = {"fillUCN12", "fillUCN34", "fillUCN1112", "fillUCN1314"};
+
+// same trees and branches as the production files; segments 12/34 -> tmcs_0, 56/78 -> tmcs_1
+bool write_run_root(const vector<EventList>& segments, double duration, const string& path) {
+	unique_ptr<TFile> fout(TFile::Open(path.c_str(), "RECREATE"));
+	if (!fout || fout->IsZombie()) {
+		cerr << "Error creating ROOT file: " << path << endl;
+		return false;
+	}
+
+	event evt;
+	TTree tmcs_0("tmcs_0", "synthetic MCS board 0");
+	TTree tmcs_1("tmcs_1", "synthetic MCS board 1");
+	for (TTree* tree : {&tmcs_0, &tmcs_1}) {
+		tree->Branch("channel", &evt.channel, "channel/I");
+		tree->Branch("edge", &evt.edge, "edge/I");
+		tree->Branch("tag", &evt.tag, "tag/I");
+		tree->Branch("full", &evt.full, "full/I");
+		tree->Branch("time", &evt.time, "time/l");
+		tree->Branch("realtime", &evt.realtime, "realtime/D");
+	}
+	for (size_t seg = 0; seg < segments.size(); ++seg) {
+		TTree& tree = seg < 2 ? tmcs_0 : tmcs_1;
+		for (const auto& e : segments[seg]) {
+			evt = e;
+			tree.Fill();
+		}
+	}
+
+	double tems_time = duration; // run-duration estimate (see processfile)
+	TTree tems("tems", "synthetic EMS");
+	tems.Branch("time", &tems_time, "time/D");
+	tems.Fill();
+
+	fout->cd();
+	tmcs_0.Write();
+	tmcs_1.Write();
+	tems.Write();
+	fout->Close();
+	return true;
+}
+
+int main(int argc, char **argv) {
+	string cfg_path = argc == 2 ? argv[1] : "./config/synthetic_config.json";
+	json cfg;
+	{
+		ifstream f(cfg_path);
+		if (!f) {
+			cerr << "Could not open config file: " << cfg_path << endl;
+			return 1;
+		}
+		f >> cfg;
+	}
+
+	string data_folder = ensureTrailingSlash(cfg.value("data_folder", "./synthetic/"));
+	int start_run = cfg.value("start_run", 900000);
+	vector<double> hold_times = cfg.value("hold_times", vector<double>{20, 50, 100, 200, 1550});
+	int runs_per_hold = cfg.value("runs_per_hold", 1);
+	double lifetime = cfg.value("lifetime", 877.75); // s; signal rate scales as exp(-hold/lifetime)
+	double neutron_rate = cfg.value("neutron_rate", 50.0); // per segment at zero hold
+
+	SyntheticParams base;
+	base.peMean = cfg.value("pe_mean", base.peMean);
+	base.peSigma = cfg.value("pe_sigma", base.peSigma);
+	base.pileupFraction = cfg.value("pileup_fraction", base.pileupFraction);
+	base.pileupWindowUs = cfg.value("pileup_window_us", base.pileupWindowUs);
+	base.backgroundRate = cfg.value("background_rate", base.backgroundRate);
+	uint64_t seed = cfg.value("seed", uint64_t(1));
+
+	std::cout << "====================================" << std::endl;
+	std::cout << "Data folder: "   << data_folder << "\n";
+	std::cout << "Runs: "          << start_run << " ... " << start_run + hold_times.size() * runs_per_hold - 1 << "\n";
+	std::cout << "Neutron rate: "  << neutron_rate << " /s, lifetime " << lifetime << " s\n";
+	std::cout << "PE: "            << base.peMean << " +- " << base.peSigma << ", pileup " << base.pileupFraction << "\n";
+	std::cout << "Background: "    << base.backgroundRate << " PE/s\n";
+	std::cout << "====================================" << std::endl;
+
+	// windows follow analysis_setup with fill_time = clean_time = 0:
+	// signal [hold+40, hold+100) s, background [hold+150, hold+210) s
+	json runinfo;
+	ofstream runlist(data_folder + "runlist_synthetic.txt");
+	if (!runlist.is_open()) {
+		cerr << "Error opening output in " << data_folder << endl;
+		return 1;
+	}
+	int run = start_run;
+	for (double hold : hold_times) {
+		for (int rep = 0; rep < runs_per_hold; ++rep, ++run) {
+			SyntheticParams p = base;
+			p.neutronStart = hold + 40;
+			p.neutronStop = hold + 100;
+			p.duration = hold + 210;
+			p.neutronRate = neutron_rate * exp(-hold / lifetime);
+			p.seed = seed + run;
+
+			vector<vector<TruthPulse>> truth;
+			vector<EventList> segments = generateSyntheticRun(p, &truth);
+			string tag = to_string(run);
+			if (!write_run_root(segments, p.duration, data_folder + "processed_output_" + tag + ".root") ||
+			    !writeTruthCSV(truth, segment_labels, data_folder + "truth_" + tag + ".csv")) {
+				return 1;
+			}
+
+			json info = {{"run_number", run}, {"run_type", "production"},
+			             {"fill_time", 0.0}, {"hold_time", hold}, {"clean_time", 0.0}};
+			for (const auto& key : fill_keys) info[key] = 1.0; // equal fills: no normalization spread
+			runinfo[tag] = info;
+			runlist << tag << "\n";
+			cout << "Run " << tag << ": hold " << hold << " s, " << truth[0].size() << " neutrons in segment 12" << endl;
+		}
+	}
+
+	ofstream info_out(data_folder + "runinfo_synthetic.json");
+	info_out << runinfo.dump(2) << endl;
+	cout << "Runinfo written to " << data_folder << "runinfo_synthetic.json" << endl;
+	return 0;
+}
@@ -0,0 +1,93 @@
+#include "Lifetime_Fit.h"
+#include <cmath>
+#include <limits>
+#include <algorithm>
+
+using namespace std;
+
+namespace {
+
+// chi2(tau) with A = Ahat(tau); returns +inf where the model is undefined
+double chi2ForTau(double tau, const vector<double>& y, const vector<double>& t,
+                  const vector<double>& w, double* Ahat = nullptr)
+{
+    const double inf = numeric_limits<double>::infinity();
+    if (tau <= 0) return inf;
+    double num = 0.0, den = 0.0;
+    for (size_t i = 0; i < y.size(); ++i) {
+        double m = exp(-t[i] / tau);
+        num += w[i] * y[i] * m;
+        den += w[i] * m * m;
+    }
+    if (den <= 0) return inf;
+    double A = num / den;
+    double chi2 = 0.0;
+    for (size_t i = 0; i < y.size(); ++i) {
+        double r = y[i] - A * exp(-t[i] / tau);
+        chi2 += w[i] * r * r;
+    }
+    if (Ahat) *Ahat = A;
+    return chi2;
+}
+
+} // namespace
+
+TauFit fitTauProfiled(const vector<double>& counts, const vector<double>& ts, bool scanErrors) {
+    const double nan = numeric_limits<double>::quiet_NaN();
+    const double tauMin = 1.0, tauMax = 1e6;
+
+    vector<double> w(counts.size());
+    for (size_t i = 0; i < counts.size(); ++i) {
+        double err = sqrt(max(counts[i], 1e-9)); // heuristic sigma after normalization
+        w[i] = 1.0 / (err * err);
+    }
+    auto chi2 = [&](double tau) { return chi2ForTau(tau, counts, ts, w); };
+
+    // bracket the global minimum on a log grid, then golden-section inside the bracket
+    const int nGrid = 241;
+    double bestTau = 800.0, bestChi2 = chi2(800.0);
+    int bestIdx = -1;
+    vector<double> grid(nGrid);
+    for (int k = 0; k < nGrid; ++k) {
+        grid[k] = tauMin * pow(tauMax / tauMin, double(k) / (nGrid - 1));
+        double c = chi2(grid[k]);
+        if (c < bestChi2) { bestChi2 = c; bestTau = grid[k]; bestIdx = k; }
+    }
+    if (bestIdx >= 0) {
+        double a = grid[max(bestIdx - 1, 0)], b = grid[min(bestIdx + 1, nGrid - 1)];
+        const double g = 0.5 * (sqrt(5.0) - 1.0);
+        double x1 = b - g * (b - a), x2 = a + g * (b - a);
+        double f1 = chi2(x1), f2 = chi2(x2);
+        while (b - a > 1e-9 * (a + b)) {
+            if (f1 < f2) { b = x2; x2 = x1; f2 = f1; x1 = b - g * (b - a); f1 = chi2(x1); }
+            else         { a = x1; x1 = x2; f1 = f2; x2 = a + g * (b - a); f2 = chi2(x2); }
+        }
+        double x = 0.5 * (a + b), fx = chi2(x);
+        if (fx <= bestChi2) { bestTau = x; bestChi2 = fx; }
+    }
+
+    TauFit fit = {bestTau, nan, nan, bestChi2};
+    chi2ForTau(bestTau, counts, ts, w, &fit.amplitude);
+    if (!scanErrors) return fit;
+
+    // scan around best to get the delta-chi2 = 1 band
+    const int nScan = 2001;
+    double span = max(50.0, 0.15 * bestTau);
+    double lo = max(tauMin, bestTau - span), hi = bestTau + span;
+    vector<double> taus(nScan), vals(nScan);
+    double minVal = numeric_limits<double>::infinity();
+    for (int k = 0; k < nScan; ++k) {
+        taus[k] = lo + (hi - lo) * k / (nScan - 1);
+        vals[k] = chi2(taus[k]);
+        if (!isnan(vals[k])) minVal = min(minVal, vals[k]);
+    }
+    int left = -1, right = -1;
+    for (int k = 0; k < nScan; ++k) {
+        if (vals[k] < minVal + 1.0) {
+            if (left < 0) left = k;
+            right = k;
+        }
+    }
+    if (left >= 0) fit.dtau = 0.5 * (taus[right] - taus[left]);
+    return fit;
+}
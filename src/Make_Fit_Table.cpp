@@ -0,0 +1,36 @@
+// Precomputes the fit of every tiny window (see Fit_Table.h) for the fit_table config key.
+// Usage: Make_Fit_Table <table.gz> [--max-bins <n>] [--max-counts <c>]
+// Rerun whenever pdfParams_ or the fit code changes: Pulse_Analysis ignores a stale table.
+#include "Pulse_Fitting.h"
+#include "Fit_Table.h"
+#include <chrono>
+#include <iostream>
+
+using namespace std;
+
+int main(int argc, char **argv) {
+    string outPath;
+    int maxBins = 6;
+    int maxCounts = 12;
+    for (int a = 1; a < argc; ++a) {
+        string arg = argv[a];
+        if (arg == "--max-bins" && a + 1 < argc) maxBins = stoi(argv[++a]);
+        else if (arg == "--max-counts" && a + 1 < argc) maxCounts = stoi(argv[++a]);
+        else if (outPath.empty() && arg[0] != '-') outPath = arg;
+        else outPath.clear(), a = argc; // fall through to usage
+    }
+    if (outPath.empty()) {
+        cerr << "Usage: Make_Fit_Table <table.gz> [--max-bins <n>] [--max-counts <c>]" << endl;
+        return 1;
+    }
+
+    auto start = chrono::steady_clock::now();
+    EventList noEvents;
+    Pulse_Fitting fitter(noEvents);
+    Fit_Table table;
+    if (!table.build(fitter, maxBins, maxCounts) || !table.save(outPath)) return 1;
+    double s = chrono::duration<double>(chrono::steady_clock::now() - start).count();
+    cout << "Fit table: " << table.size() << " windows (up to " << maxBins << " bins, " << maxCounts
+         << " counts) in " << s << " s -> " << outPath << endl;
+    return 0;
+}
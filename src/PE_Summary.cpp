@@ -0,0 +1,155 @@
+#include "PE_Summary.h"
+#include <algorithm>
+#include <fstream>
+#include <iostream>
+#include <cmath>
+#include <cstring>
+#include <zlib.h>
+
+using namespace std;
+
+namespace {
+
+const char kSummaryMagic[8] = {'U', 'C', 'N', 'P', 'E', 'S', 'M', '1'};
+
+struct SummaryHeader {
+    char magic[8];
+    int32_t run;
+    uint32_t nSegments;
+    uint32_t binsPerPE;
+    uint32_t nBins;
+    uint64_t rawBytes;
+    uint64_t storedBytes;
+};
+static_assert(sizeof(SummaryHeader) == 40, "summary header layout is part of the file format");
+
+// histogram a table into per-bin counts; bin k holds PE in (k, k+1] / binsPerPE
+void fillBins(const PulseTable& t, uint32_t binsPerPE, uint32_t nBins, uint32_t* hist) {
+    for (double pe : t.pe) {
+        long k = static_cast<long>(ceil(pe * binsPerPE)) - 1;
+        if (k < 0) continue; // PE <= 0 never passes a threshold
+        if (k >= static_cast<long>(nBins)) k = nBins - 1;
+        hist[k]++;
+    }
+}
+
+} // namespace
+
+uint32_t PESummary::countAbove(size_t seg, int event, double threshold) const {
+    if (nBins == 0 || (seg * 2 + event + 1) * nBins > above.size()) return 0;
+    long k = lround(threshold * binsPerPE);
+    if (k < 0) k = 0;
+    if (k >= static_cast<long>(nBins)) return 0;
+    return cumulative(seg, event)[k];
+}
+
+bool PESummary::add(const PESummary& other) {
+    if (above.empty()) {
+        int keepRun = run;
+        *this = other;
+        run = keepRun;
+        return true;
+    }
+    if (other.binsPerPE != binsPerPE || other.nBins != nBins) return false;
+    // segments are matched by label: a run may lack some (a CSV holds no rows for an empty segment)
+    size_t rows = 2 * static_cast<size_t>(nBins);
+    for (size_t o = 0; o < other.labels.size(); ++o) {
+        size_t seg = find(labels.begin(), labels.end(), other.labels[o]) - labels.begin();
+        if (seg == labels.size()) {
+            labels.push_back(other.labels[o]);
+            above.resize(above.size() + rows, 0);
+        }
+        const uint32_t* src = other.above.data() + o * rows;
+        uint32_t* dst = above.data() + seg * rows;
+        for (size_t i = 0; i < rows; ++i) dst[i] += src[i];
+    }
+    return true;
+}
+
+PESummary buildPESummary(const RunPulses& pulses, int run, uint32_t binsPerPE, double maxPE) {
+    PESummary s;
+    s.run = run;
+    s.binsPerPE = binsPerPE;
+    s.nBins = static_cast<uint32_t>(ceil(maxPE * binsPerPE));
+    s.above.assign(pulses.size() * 2 * s.nBins, 0);
+
+    for (size_t seg = 0; seg < pulses.size(); ++seg) {
+        s.labels.push_back(pulses[seg].label);
+        for (int event = 0; event < 2; ++event) {
+            uint32_t* row = s.above.data() + (seg * 2 + event) * s.nBins;
+            fillBins(event ? pulses[seg].signal : pulses[seg].background, binsPerPE, s.nBins, row);
+            // suffix sum: row[k] = #pulses with PE > k / binsPerPE
+            for (long k = static_cast<long>(s.nBins) - 2; k >= 0; --k) row[k] += row[k + 1];
+        }
+    }
+    return s;
+}
+
+vector<char> encodePESummary(const PESummary& s) {
+    SummaryHeader h = {};
+    memcpy(h.magic, kSummaryMagic, sizeof(kSummaryMagic));
+    h.run = s.run;
+    h.nSegments = static_cast<uint32_t>(s.labels.size());
+    h.binsPerPE = s.binsPerPE;
+    h.nBins = s.nBins;
+    h.rawBytes = s.above.size() * sizeof(uint32_t);
+
+    // cumulative counts are long flat runs: compress well
+    uLongf zlen = compressBound(h.rawBytes);
+    vector<Bytef> z(zlen);
+    compress2(z.data(), &zlen, reinterpret_cast<const Bytef*>(s.above.data()), h.rawBytes, 6);
+    h.storedBytes = zlen;
+
+    vector<char> buf(sizeof(h) + 8 * h.nSegments + zlen, 0);
+    memcpy(buf.data(), &h, sizeof(h));
+    for (size_t seg = 0; seg < s.labels.size(); ++seg) {
+        strncpy(buf.data() + sizeof(h) + 8 * seg, s.labels[seg].c_str(), 7);
+    }
+    memcpy(buf.data() + sizeof(h) + 8 * h.nSegments, z.data(), zlen);
+    return buf;
+}
+
+bool decodePESummary(const char* data, size_t size, PESummary& s) {
+    SummaryHeader h;
+    if (size < sizeof(h)) return false;
+    memcpy(&h, data, sizeof(h));
+    if (memcmp(h.magic, kSummaryMagic, sizeof(kSummaryMagic)) != 0) return false;
+    if (sizeof(h) + 8 * h.nSegments + h.storedBytes > size ||
+        h.rawBytes != uint64_t(h.nSegments) * 2 * h.nBins * sizeof(uint32_t)) return false;
+
+    s.run = h.run;
+    s.binsPerPE = h.binsPerPE;
+    s.nBins = h.nBins;
+    s.labels.clear();
+    const char* p = data + sizeof(h);
+    for (uint32_t seg = 0; seg < h.nSegments; ++seg, p += 8) s.labels.emplace_back(p, strnlen(p, 8));
+
+    s.above.resize(h.rawBytes / sizeof(uint32_t));
+    uLongf rawLen = h.rawBytes;
+    if (uncompress(reinterpret_cast<Bytef*>(s.above.data()), &rawLen,
+                   reinterpret_cast<const Bytef*>(p), h.storedBytes) != Z_OK || rawLen != h.rawBytes) {
+        cerr << "Failed to decompress PE summary for run " << h.run << endl;
+        return false;
+    }
+    return true;
+}
+
+bool writePESummary(const PESummary& summary, const string& path) {
+    ofstream out(path, ios::binary);
+    if (!out.is_open()) {
+        cerr << "Error opening output file: " << path << endl;
+        return false;
+    }
+    vector<char> buf = encodePESummary(summary);
+    out.write(buf.data(), buf.size());
+    return static_cast<bool>(out);
+}
+
+bool readPESummary(const string& path, PESummary& summary) {
+    ifstream in(path, ios::binary | ios::ate);
+    if (!in.is_open()) return false;
+    vector<char> buf(static_cast<size_t>(in.tellg()));
+    in.seekg(0);
+    if (!in.read(buf.data(), buf.size())) return false;
+    return decodePESummary(buf.data(), buf.size(), summary);
+}
@@ -0,0 +1,141 @@
+#include "Plot_Tail.h"
+#include "File_Loader.h"
+#include <fstream>
+#include <sstream>
+#include <iostream>
+#include <memory>
+#include <TROOT.h>
+#include <TCanvas.h>
+#include <TH1D.h>
+#include <TLegend.h>
+#include <TStyle.h>
+
+using namespace std;
+
+// Read the tail CSV: "Time(us),Segment_<label>,..." then one row per bin
+bool LoadTail(const string& input_path, vector<vector<double>>& tails,
+              vector<string>& segment_labels, double& binWidth)
+{
+    ifstream in(input_path);
+    if (!in.is_open()) {
+        cerr << "Failed to open tail file: " << input_path << endl;
+        return false;
+    }
+
+    string line, cell;
+    if (!getline(in, line)) return false;
+
+    // header: skip the time column, strip "Segment_" from the rest
+    segment_labels.clear();
+    stringstream header(line);
+    getline(header, cell, ',');
+    while (getline(header, cell, ',')) {
+        const string prefix = "Segment_";
+        if (cell.compare(0, prefix.size(), prefix) == 0) cell = cell.substr(prefix.size());
+        segment_labels.push_back(cell);
+    }
+
+    tails.assign(segment_labels.size(), {});
+    vector<double> times;
+    while (getline(in, line)) {
+        if (line.empty()) continue;
+        stringstream row(line);
+        getline(row, cell, ',');
+        times.push_back(stod(cell));
+        for (size_t seg = 0; seg < tails.size() && getline(row, cell, ','); ++seg) {
+            tails[seg].push_back(stod(cell));
+        }
+    }
+
+    if (times.empty() || segment_labels.empty()) return false;
+    binWidth = (times.size() > 1) ? times[1] - times[0] : 0.1;
+    return true;
+}
+
+// Draw summed tails on two pads (linear, log y) and save as image
+void PlotTail(const vector<vector<double>>& tails, const vector<string>& segment_labels,
+              double binWidth, const string& output_path)
+{
+    gROOT->SetBatch(kTRUE); // no display/X11 needed
+    gStyle->SetOptStat(0);
+
+    TCanvas c1("c1", "Tail Histograms", 1200, 600);
+    c1.Divide(2, 1);
+
+    vector<int> colors = {kRed, kBlue, kGreen+2, kMagenta};
+    int nBins = tails[0].size();
+
+    vector<unique_ptr<TH1D>> hists;
+    hists.reserve(tails.size());
+    for (size_t seg = 0; seg < tails.size(); ++seg) {
+        string name  = "h" + segment_labels[seg];
+        string title = "Segment " + segment_labels[seg];
+        auto h = make_unique<TH1D>(name.c_str(), title.c_str(), nBins, 0, nBins * binWidth);
+        h->SetDirectory(nullptr); // owned here, not by gDirectory
+        for (int i = 0; i < nBins; ++i) h->SetBinContent(i+1, tails[seg][i]);
+        h->SetLineColor(colors[seg % colors.size()]);
+        h->SetLineWidth(2);
+        h->GetXaxis()->SetTitle("Time after pulse (#mu s)");
+        h->GetYaxis()->SetTitle("Counts");
+        hists.push_back(move(h));
+    }
+
+    // ---- Pad 1: linear ----
+    c1.cd(1);
+    gPad->SetGrid();
+    TLegend leg1(0.65, 0.70, 0.88, 0.88);
+    for (size_t i = 0; i < hists.size(); ++i) {
+        if (i == 0) hists[i]->SetTitle("Summed Tail Response (linear)");
+        hists[i]->Draw(i == 0 ? "HIST" : "HIST SAME");
+        leg1.AddEntry(hists[i].get(), ("Segment " + segment_labels[i]).c_str(), "l");
+    }
+    leg1.Draw();
+
+    // ---- Pad 2: log ----
+    c1.cd(2);
+    gPad->SetGrid();
+    gPad->SetLogy();  // log-scale y-axis
+    TLegend leg2(0.65, 0.70, 0.88, 0.88);
+    for (size_t i = 0; i < hists.size(); ++i) {
+        if (i == 0) hists[i]->SetTitle("Summed Tail Response (log y)");
+        hists[i]->Draw(i == 0 ? "HIST" : "HIST SAME");
+        leg2.AddEntry(hists[i].get(), ("Segment " + segment_labels[i]).c_str(), "l");
+    }
+    leg2.Draw();
+
+    c1.SaveAs(output_path.c_str());
+}
+
+int main(int argc, char **argv) {
+    // explicit mode: Plot_Tail <summed_tail.csv> <out.png>
+    // config mode:   Plot_Tail [config.json] -> summed tail of [start_run, end_run) from Pulse_Tail
+    string input_path, output_path;
+    if (argc == 3) {
+        input_path = argv[1];
+        output_path = argv[2];
+    } else {
+        Config cfg;
+        try {
+            cfg = load_config(argc, argv);
+        } catch (const exception& e) {
+            cerr << "Error starting program: " << e.what() << endl;
+            cerr << "Usage (direct): Plot_Tail <summed_tail.csv> <out.png>" << endl;
+            return 1;
+        }
+        string output_folder = ensureTrailingSlash(cfg.output_folder);
+        string range = to_string(cfg.start_run) + "_" + to_string(cfg.end_run);
+        input_path  = output_folder + "tail/summed_tail_response_" + range + ".csv";
+        output_path = output_folder + "graphs/summed_tail_response" + range + ".png";
+    }
+
+    vector<vector<double>> tails;
+    vector<string> segment_labels;
+    double binWidth = 0.1;
+    if (!LoadTail(input_path, tails, segment_labels, binWidth)) {
+        cerr << "No tail data in " << input_path << endl;
+        return 1;
+    }
+
+    PlotTail(tails, segment_labels, binWidth, output_path);
+    return 0;
+}
@@ -1,15 +1,24 @@
 #include "Pulse_Analysis.h"
 #include "Pulse_Fitting.h"
 #include "File_Loader.h"
+#include "Pulse_Output.h"
+#include "PE_Summary.h"
+#include "Stage_Timer.h"
+#include "Trace.h"
 #include <json.hpp>
 #include <iostream>
 #include <fstream>
 #include <set>
+#include <memory>
+#include <chrono>
+#include <filesystem>
+#include <iomanip>
 
 using namespace std;
 
-// Set up and run the analysis, output to csv file
-void analysis_setup(const vector<EventList> run_data, json params, string output_folder) { // Event format: <time (us), PE #, event #, window width, # of events in window>
+// Set up and run the analysis, output to csv (or binary columnar) file
+void analysis_setup(const vector<EventList>& run_data, json params, string output_folder, const Config& cfg,
+                    Result_Store* store, Window_Corpus* corpus, Fit_Memo* memo, const Fit_Table* table) { // Event format: <time (us), PE #, event #, window width, # of events in window>
 	
 	//define signal and background windows (us) from run parameters
 	double start = (double)params["fill_time"] + (double)params["hold_time"] + (double)params["clean_time"] + 40;
@@ -17,44 +26,156 @@ void analysis_setup(const vector<EventList> run_data, json params, string output
 	double bg_start = stop + 50;
 	
 	vector<string> segment_labels = {"12", "34", "56", "78"};
-	string output_file = output_folder + "results/PulseAnalysis_" + to_string(params["run_number"]) + ".csv";
+	int run = params["run_number"];
+	TRACE_SCOPE("analysis_setup", {{"run", run}});
+	StageSnapshot run_start = snapshotStages(); // per-run counter / allocation report
+	RunPulses pulses;
 
-	ofstream out(output_file);
-	if (!out.is_open()) {
-		cerr << "Error opening output file: " << output_file << endl;
-		return;
+	// per-window fit statistics for tuning NLopt (optional)
+	unique_ptr<Fit_Telemetry> telemetry;
+	string telemetry_file = output_folder + "results/FitTelemetry_" + to_string(run);
+	if (cfg.fit_telemetry) {
+		try {
+			telemetry = make_unique<Fit_Telemetry>(run, telemetry_file + ".csv");
+		} catch (const std::exception& e) {
+			cerr << e.what() << ", telemetry off for run " << run << endl;
+		}
 	}
 
-	out << "Segment, Time (us), PE, Event\n";
-
 	for (size_t seg = 0; seg < run_data.size(); ++seg) {
 		// run pulse fitting on each segment independently
 		cout << "Segment: " << segment_labels[seg] << endl;
+		TRACE_SCOPE("segment", {{"run", run}, {"segment", segment_labels[seg]}});
 		Pulse_Fitting fitter(run_data[seg]);
 		fitter.setWindow(start * 1e6, stop * 1e6);
 		fitter.setBackgroundWindow(bg_start * 1e6);
+		fitter.setKernelTolerance(cfg.kernel_tolerance);
+		fitter.setRecursiveKernel(cfg.recursive_kernel);
+		fitter.setIncrementalLikelihood(cfg.incremental_likelihood);
+		fitter.setWindowTriage(cfg.window_triage);
+		fitter.setWindowSplitting(cfg.split_window_bins);
+		fitter.setFitMemo(memo);
+		fitter.setFitTable(table);
+		if (corpus) fitter.setCorpus(corpus, run, segment_labels[seg]);
+		if (telemetry) fitter.setTelemetry(telemetry.get(), segment_labels[seg]);
 		fitter.analyze();
-		auto signalPulses = fitter.getSignalPulses();
-		auto backgroundPulses = fitter.getBackgroundPulses();
-
-		// write signal pulsese (Event=1)
-		for (const auto& event : signalPulses) {
-			out << segment_labels[seg] << ", "
-				<< get<0>(event)/1e6 << ", "
-				<< get<1>(event) << ", "
-				<< "1 \n";
+		pulses.push_back({segment_labels[seg], fitter.takeSignalPulses(), fitter.takeBackgroundPulses()});
+	}
+
+	if (telemetry) {
+		telemetry->writeSummary(telemetry_file + ".json");
+		json s = telemetry->summary();
+		cout << "Fit telemetry: " << s["windows"] << " windows, " << s["refits"] << " refits, "
+		     << s["maxeval_reached"] << " at maxeval, mean fit " << s["fit_us_mean"] << " us" << endl;
+	}
+
+	if (memo) {
+		Fit_Memo::Stats m = memo->stats();
+		cout << "Fit memo: " << m.hits << " / " << m.lookups << " lookups hit ("
+		     << (m.lookups ? 100.0 * m.hits / m.lookups : 0.0) << "%), " << m.entries << " entries, "
+		     << m.bytes / 1048576.0 << " MB, " << m.evictions << " evicted" << endl;
+	}
+	if (table) {
+		cout << "Fit table: " << table->hits() << " / " << table->lookups() << " lookups hit (job total)" << endl;
+	}
+
+	stageTotals_.count(stageTotals_.runs, 1);
+	{
+	ScopedStage output_timer(Stage::Output);
+	string output_file = output_folder + "results/PulseAnalysis_" + to_string(run);
+	if (store) {
+		store->commit(RecordKind::Pulses, run, encodePulseBinary(pulses, run, cfg.compress_output));
+	} else if (cfg.output_format == "binary") {
+		writePulseBinary(pulses, run, output_file + ".bin", cfg.compress_output);
+	} else {
+		writePulseCSV(pulses, output_file + ".csv");
+	}
+
+	// threshold-scan cube: PE > x counts per segment and window, for Calculate_Lifetime
+	if (cfg.pe_summary) {
+		PESummary summary = buildPESummary(pulses, run);
+		if (store) {
+			store->commit(RecordKind::Summary, run, encodePESummary(summary));
+		} else {
+			writePESummary(summary, output_folder + "summary/PESummary_" + to_string(run) + ".bin");
 		}
+	}
+	}
+
+	if (stageTotals_.perf) {
+		cout << "Run " << run << " hardware counters:" << endl;
+		printStageCounters(cout, run_start);
+	}
+	if (allocTracking_) {
+		cout << "Run " << run << " heap allocations:" << endl;
+		printStageAllocs(cout, run_start);
+	}
+}
+
+// benchmark mode: throughput and wall-time split over the pipeline stages for this job
+void write_benchmark_report(const string& path, double wall_s) {
+	double runs = stageTotals_.runs, hits = stageTotals_.peHits, windows = stageTotals_.windows;
+	json report;
+	report["wall_s"] = wall_s;
+	report["runs"] = stageTotals_.runs.load();
+	report["pe_hits"] = stageTotals_.peHits.load();
+	report["windows"] = stageTotals_.windows.load();
+	report["runs_per_hour"] = runs / wall_s * 3600.0;
+	report["pe_hits_per_s"] = hits / wall_s;
+	report["windows_per_s"] = windows / wall_s;
+	report["windows_triaged"] = {{"narrow", stageTotals_.triagedNarrow.load()},
+	                             {"few_hits", stageTotals_.triagedFewHits.load()}};
 
-		// write background pulses (Event=0)
-		for (const auto& event : backgroundPulses) {
-			out << segment_labels[seg] << ", "
-				<< get<0>(event)/1e6 << ", "
-				<< get<1>(event) << ", "
-				<< "0 \n";
+	cout << "====================================" << endl;
+	cout << "Benchmark: " << runs << " runs in " << wall_s << " s (" << runs / wall_s * 3600.0 << " runs/h, "
+	     << hits / wall_s << " PE hits/s, " << windows / wall_s << " windows/s)" << endl;
+	cout << "Triaged before histogramming: " << stageTotals_.triagedNarrow << " narrow, "
+	     << stageTotals_.triagedFewHits << " with fewer than " << Pulse_Fitting::kMinPE << " hits" << endl;
+	double accounted = 0.0;
+	json stages = json::object();
+	for (int k = 0; k < static_cast<int>(Stage::Count); ++k) {
+		double sec = stageTotals_.ns[k] / 1e9;
+		accounted += sec;
+		stages[stageName(static_cast<Stage>(k))] = sec;
+		cout << "  " << left << setw(20) << stageName(static_cast<Stage>(k)) << right << setw(10) << fixed
+		     << setprecision(3) << sec << " s  " << setw(5) << setprecision(1) << 100.0 * sec / wall_s << " %" << endl;
+	}
+	stages["other"] = wall_s - accounted; // config, runinfo, logging, summaries
+	cout << defaultfloat << "====================================" << endl;
+	report["stage_s"] = stages;
+
+	if (stageTotals_.perf) { // hardware counters per stage (user space)
+		json counters = json::object();
+		for (int k = 0; k < kStages; ++k) {
+			json c;
+			for (int e = 0; e < kPerfEvents; ++e) c[perfEventName(e)] = stageTotals_.counters[k][e].load();
+			counters[stageName(static_cast<Stage>(k))] = c;
 		}
+		report["counters"] = counters;
 	}
-	
-	out.close();
+	if (allocTracking_) { // heap traffic per stage; per window for the fitting path
+		json allocs = json::object();
+		uint64_t window_allocs = 0, window_bytes = 0;
+		for (int k = 0; k < kStages; ++k) {
+			allocs[stageName(static_cast<Stage>(k))] = {{"allocs", stageTotals_.allocs[k].load()},
+			                                            {"bytes", stageTotals_.allocBytes[k].load()}};
+		}
+		for (Stage s : {Stage::WindowSegmentation, Stage::KernelBuild, Stage::Fitting}) {
+			window_allocs += stageTotals_.allocs[static_cast<int>(s)];
+			window_bytes += stageTotals_.allocBytes[static_cast<int>(s)];
+		}
+		report["allocs"] = allocs;
+		report["allocs_per_window"] = windows > 0 ? window_allocs / windows : 0.0;
+		report["alloc_bytes_per_window"] = windows > 0 ? window_bytes / windows : 0.0;
+	}
+
+	ofstream out(path);
+	if (!out.is_open()) {
+		cerr << "Error opening benchmark report: " << path << endl;
+		return;
+	}
+	out << report.dump(2) << endl;
+	cout << "Benchmark report written to " << path << endl;
 }
 	
 int main(int argc, char **argv) {
@@ -69,12 +190,26 @@ int main(int argc, char **argv) {
         std::cout << "Start run: "     << cfg.start_run     << "\n";
         std::cout << "End run: "       << cfg.end_run       << "\n";
         std::cout << "Save to txt: "   << (cfg.save_to_txt ? "true" : "false") << "\n";
+        std::cout << "Output format: " << cfg.output_format << (cfg.compress_output ? " (zlib)" : "") << "\n";
+        std::cout << "Result store: "  << (cfg.result_store.empty() ? "(per-run files)" : cfg.result_store) << "\n";
+        std::cout << "Benchmark: "     << (cfg.benchmark ? "true" : "false")
+                  << (cfg.perf_counters ? " (+ hardware counters)" : "")
+                  << (cfg.alloc_tracking ? " (+ allocation tracking)" : "") << "\n";
+        std::cout << "Window corpus: " << (cfg.window_corpus.empty() ? "(off)" : cfg.window_corpus) << "\n";
+        std::cout << "Fit memo: "      << (cfg.fit_memo_mb > 0 ? to_string(cfg.fit_memo_mb) + " MB" : "(off)")
+                  << (cfg.fit_memo_file.empty() ? "" : ", " + cfg.fit_memo_file) << "\n";
+        std::cout << "Fit table: "     << (cfg.fit_table.empty() ? "(off)" : cfg.fit_table) << "\n";
         std::cout << "Good runs loaded: " << cfg.good_runs_set.size() << " entries\n";
 		std::cout << "====================================" << std::endl;
 	} catch (const std::exception& e) {
 		cerr << "Error starting program: " << e.what() << endl;
 		return 1;
 	}
+	if (cfg.split_window_bins > 0 && cfg.split_window_bins < Pulse_Fitting::minSplitBins()) { // fitters use the default bins
+		cerr << "Error: split_window_bins " << cfg.split_window_bins << " is below the minimum "
+		     << Pulse_Fitting::minSplitBins() << " (twice the part overlap)" << endl;
+		return 1;
+	}
 
 	std::string data_folder   = ensureTrailingSlash(cfg.data_folder);
     std::string output_folder = ensureTrailingSlash(cfg.output_folder);
@@ -84,7 +219,65 @@ int main(int argc, char **argv) {
 	json params = cfg.runinfo_json;
 	const std::set<std::string>& good_runs = cfg.good_runs_set;
 	vector<EventList> run_data;
+
+	// consolidated store shared by all runs of this job (optional)
+	unique_ptr<Result_Store> store;
+	if (!cfg.result_store.empty() && !save_to_txt) {
+		try {
+			store = make_unique<Result_Store>(cfg.result_store);
+		} catch (const std::exception& e) {
+			cerr << "Error opening result store: " << e.what() << endl;
+			return 1;
+		}
+	}
+	
+	// per-run PE cubes go to <output>/summary/, which a fresh output folder does not have yet
+	if (cfg.pe_summary && !store && !save_to_txt) {
+		std::error_code ec;
+		std::filesystem::create_directories(output_folder + "summary", ec);
+		if (ec) {
+			cerr << "Error creating " << output_folder << "summary: " << ec.message() << endl;
+			return 1;
+		}
+	}
+	
+	// replay corpus of every fitted window (optional)
+	unique_ptr<Window_Corpus> corpus;
+	if (!cfg.window_corpus.empty() && !save_to_txt) {
+		try {
+			corpus = make_unique<Window_Corpus>(cfg.window_corpus);
+		} catch (const std::exception& e) {
+			cerr << "Error opening window corpus: " << e.what() << endl;
+			return 1;
+		}
+	}
 	
+	// memo of small-window fits, optionally carried over from earlier jobs
+	unique_ptr<Fit_Memo> memo;
+	if (cfg.fit_memo_mb > 0 && !save_to_txt) {
+		memo = make_unique<Fit_Memo>(static_cast<size_t>(cfg.fit_memo_mb * 1048576), cfg.fit_memo_max_bins);
+		if (!cfg.fit_memo_file.empty() && ifstream(cfg.fit_memo_file).good()) {
+			memo->load(cfg.fit_memo_file);
+			cout << "Fit memo: loaded " << memo->stats().entries << " entries" << endl;
+		}
+	}
+	
+	// fits of every tiny window, precomputed by Make_Fit_Table; a stale table is ignored
+	unique_ptr<Fit_Table> table;
+	if (!cfg.fit_table.empty() && !save_to_txt) {
+		table = make_unique<Fit_Table>();
+		if (table->load(cfg.fit_table)) {
+			cout << "Fit table: loaded " << table->size() << " windows" << endl;
+		} else {
+			table.reset();
+		}
+	}
+	
+	if ((cfg.benchmark || cfg.perf_counters || cfg.alloc_tracking) && !save_to_txt) {
+		enableStageAccounting(cfg.perf_counters, cfg.alloc_tracking, cerr);
+	}
+	auto wall_start = std::chrono::steady_clock::now();
+
 	if (save_to_txt) {
 		cout << "** Note: converting data to text, no analysis will be performed **" << endl;
 	}
@@ -109,7 +302,7 @@ int main(int argc, char **argv) {
 					cerr << "No data found for run " << run << ". Skipping analysis." << endl;
 					continue;
 				}
-				analysis_setup(run_data, params[run], output_folder);
+				analysis_setup(run_data, params[run], output_folder, cfg, store.get(), corpus.get(), memo.get(), table.get());
 			}
 		} else {
 			cerr << "Run " << run << " not found or not a production run. Skipping." << endl;
@@ -117,5 +310,12 @@ int main(int argc, char **argv) {
 
 	}	
 
+	if (memo && !cfg.fit_memo_file.empty()) memo->save(cfg.fit_memo_file);
+	TRACE_WRITE(output_folder + "results/trace_" + to_string(startrun) + "_" + to_string(endrun) + ".json");
+	if (cfg.benchmark && stageTotals_.enabled) {
+		double wall_s = std::chrono::duration<double>(std::chrono::steady_clock::now() - wall_start).count();
+		write_benchmark_report(output_folder + "results/benchmark_" + to_string(startrun) + "_" + to_string(endrun) + ".json", wall_s);
+	}
+
 	return 0;
 }
\ No newline at end of file
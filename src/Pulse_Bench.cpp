@@ -0,0 +1,489 @@
+// Microbenchmarks for the Pulse_Fitting hot paths on synthetic windows and runs (no ROOT files).
+// Usage: Pulse_Bench [--filter <substring>] [--min-time <s>] [--out <file.json>] [--corpus <windows.gz>] [--perf]
+// --corpus replays a production window corpus (window_corpus config key) through fitPulses instead.
+#include "Pulse_Fitting.h"
+#include "Synthetic_Events.h"
+#include "Window_Corpus.h"
+#include "Perf_Counters.h"
+#include "Alloc_Tracker.h"
+#include <json.hpp>
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdlib>
+#include <fstream>
+#include <functional>
+#include <iostream>
+#include <new>
+#include <random>
+
+#ifndef BENCH_COMMIT
+#define BENCH_COMMIT "unknown"
+#endif
+
+using namespace std;
+using json = nlohmann::json;
+
+static PerfCounterGroup* g_perf = nullptr; // --perf: hardware counters per op
+
+template <class T>
+inline void doNotOptimize(T const& value) {
+    asm volatile("" : : "r,m"(value) : "memory");
+}
+
+// ---- synthetic data ---- //
+
+// one window of ~nBins us holding nPulses pulses of ~peMean PE; filler hits keep gaps < minGap
+static vector<double> makeWindowTimes(mt19937_64& rng, double t0, int nBins, int nPulses, double peMean = 30.0) {
+    vector<double> t;
+    for (int p = 0; p < nPulses; ++p) {
+        double start = t0 + (double)p * nBins / nPulses;
+        int nPE = poisson_distribution<int>(peMean)(rng);
+        for (int k = 0; k < nPE; ++k) {
+            double d = samplePEDelay(rng);
+            if (d < nBins - (start - t0)) t.push_back(start + d);
+        }
+    }
+    for (double f = t0; f < t0 + nBins; f += 5.0) t.push_back(f);
+    t.push_back(t0 + nBins); // pin the window width
+    sort(t.begin(), t.end());
+    return t;
+}
+
+// concatenated windows separated by quiet gaps (> minGap), as seen by fitRegion
+static vector<double> makeStream(mt19937_64& rng, int nWindows, int nBins, int nPulses) {
+    vector<double> all;
+    double t0 = 0.0;
+    for (int w = 0; w < nWindows; ++w) {
+        vector<double> t = makeWindowTimes(rng, t0, nBins, nPulses);
+        all.insert(all.end(), t.begin(), t.end());
+        t0 = all.back() + 100.0;
+    }
+    return all;
+}
+
+// ---- harness ---- //
+
+struct Result {
+    string name;
+    json params;
+    double nsPerOp;
+    double allocsPerOp;
+    double bytesPerOp;
+    double evalsPerFit; // < 0: not applicable
+    json metrics; // benchmark-specific extras (fit accuracy)
+    json counters; // hardware counters per op (--perf)
+};
+
+// run 'op' (doing 'opsPerCall' operations) for at least minTime, 5 repetitions, report the median
+static Result measure(const string& name, json params, double minTime, size_t opsPerCall,
+                      const function<void()>& op, const function<long()>& evals = nullptr)
+{
+    op(); // warm-up (also fills caches that are meant to be warm)
+    vector<double> nsPerOp;
+    size_t allocs = 0, bytes = 0, ops = 0;
+    long evalCount = 0;
+    PerfValues c0, c1, perfTotal = {};
+    for (int rep = 0; rep < 5; ++rep) {
+        AllocCounts a0 = threadAllocs_;
+        long e0 = evals ? evals() : 0;
+        if (g_perf) g_perf->read(c0);
+        size_t n = 0;
+        auto start = chrono::steady_clock::now();
+        double elapsed = 0.0;
+        do {
+            op();
+            n += opsPerCall;
+            elapsed = chrono::duration<double>(chrono::steady_clock::now() - start).count();
+        } while (elapsed < minTime / 5);
+        if (g_perf && g_perf->read(c1)) {
+            for (int k = 0; k < kPerfEvents; ++k) perfTotal[k] += c1[k] - c0[k];
+        }
+        nsPerOp.push_back(elapsed * 1e9 / n);
+        allocs += threadAllocs_.allocs - a0.allocs;
+        bytes += threadAllocs_.bytes - a0.bytes;
+        evalCount += evals ? evals() - e0 : 0;
+        ops += n;
+    }
+    sort(nsPerOp.begin(), nsPerOp.end());
+    json counters = json::object();
+    if (g_perf) {
+        for (int k = 0; k < kPerfEvents; ++k) counters[perfEventName(k)] = double(perfTotal[k]) / ops;
+        if (perfTotal[PerfCycles]) counters["ipc"] = double(perfTotal[PerfInstructions]) / perfTotal[PerfCycles];
+    }
+    return {name, params, nsPerOp[2], double(allocs) / ops, double(bytes) / ops,
+            evals ? double(evalCount) / ops : -1.0, json::object(), counters};
+}
+
+class Pulse_Bench {
+    public:
+        static vector<Result> runAll(const string& filter, double minTime);
+        static vector<Result> replay(const vector<CorpusWindow>& windows, double minTime);
+};
+
+vector<Result> Pulse_Bench::runAll(const string& filter, double minTime) {
+    vector<Result> results;
+    auto wanted = [&](const string& name) { return filter.empty() || name.find(filter) != string::npos; };
+    const vector<int> lengths = {8, 32, 128}; // window length in 1 us bins
+    const vector<int> multiplicities = {1, 2, 4};
+    const int streamWindows = 256;
+
+    EventList noEvents;
+    Pulse_Fitting fitter(noEvents);
+
+    for (int nBins : lengths) {
+        for (int nPulses : multiplicities) {
+            mt19937_64 rng(1000 * nBins + nPulses); // fixed seeds: same data every run
+            json params = {{"nBins", nBins}, {"nPulses", nPulses}};
+
+            vector<double> stream = makeStream(rng, streamWindows, nBins, nPulses);
+            if (wanted("movingWindow")) {
+                results.push_back(measure("movingWindow", params, minTime, streamWindows, [&]() {
+                    for (int i = 0, N = stream.size(); i < N; ) {
+                        auto w = fitter.movingWindow(stream, i);
+                        doNotOptimize(w);
+                        i = get<1>(w);
+                    }
+                }));
+            }
+
+            vector<int> hist;
+            vector<double> xCenters;
+            if (wanted("makeHistogram")) {
+                results.push_back(measure("makeHistogram", params, minTime, streamWindows, [&]() {
+                    double width, start, end;
+                    int j;
+                    for (int i = 0, N = stream.size(); i < N; i = j) {
+                        fitter.makeHistogram(stream, i, fitter.binWidth_, width, j, start, end, hist, xCenters);
+                        doNotOptimize(hist.data());
+                    }
+                }));
+            }
+
+            if (wanted("fitRegion")) { // whole per-window pipeline, warm PDF cache
+                PulseTable out;
+                results.push_back(measure("fitRegion", params, minTime, streamWindows, [&]() {
+                    out.clear();
+                    fitter.fitRegion(stream, out);
+                    doNotOptimize(out.size());
+                }, [&]() { return fitter.nllEvals_; }));
+            }
+            if (wanted("fitRegionRecursive")) { // same stream without kernel tables
+                PulseTable out;
+                fitter.setRecursiveKernel(true);
+                results.push_back(measure("fitRegionRecursive", params, minTime, streamWindows, [&]() {
+                    out.clear();
+                    fitter.fitRegion(stream, out);
+                    doNotOptimize(out.size());
+                }, [&]() { return fitter.nllEvals_; }));
+                fitter.setRecursiveKernel(false);
+            }
+
+            // one representative window for the per-window stages
+            vector<double> times = makeWindowTimes(rng, 0.0, nBins, nPulses);
+            double width, start, end;
+            int j;
+            fitter.makeHistogram(times, 0, fitter.binWidth_, width, j, start, end, hist, xCenters);
+
+            if (nPulses == 1 && wanted("analyticPDF")) { // independent of multiplicity
+                results.push_back(measure("analyticPDF", {{"nBins", nBins}}, minTime, 1, [&]() {
+                    doNotOptimize(fitter.analyticPDF(xCenters, 0));
+                }));
+            }
+            if (nPulses == 1 && wanted("generatePDFLookup")) {
+                results.push_back(measure("generatePDFLookup", {{"nBins", nBins}}, minTime, 1, [&]() {
+                    fitter.pdfCache_.clear(); // cold: full kernel build
+                    doNotOptimize(fitter.generatePDFLookup(xCenters));
+                }));
+            }
+            if (wanted("findGradientPeaks")) {
+                vector<int> peaks;
+                results.push_back(measure("findGradientPeaks", params, minTime, 1, [&]() {
+                    fitter.findGradientPeaks(hist, 2.0, 3, peaks);
+                    doNotOptimize(peaks.data());
+                }));
+            }
+
+            vector<vector<double>> pdfLookup = fitter.generatePDFLookup(xCenters);
+            if (wanted("negLogLikelihood")) {
+                vector<double> x;
+                for (int p = 0; p < nPulses; ++p) x.push_back(30.0);
+                for (int p = 0; p < nPulses; ++p) x.push_back((double)p * nBins / nPulses);
+                results.push_back(measure("negLogLikelihood", params, minTime, 1, [&]() {
+                    doNotOptimize(fitter.negLogLikelihood(x, hist, pdfLookup, nPulses));
+                }));
+                Pulse_Fitting::NLLKernel kernel = Pulse_Fitting::nllKernel(nPulses); // what fitPulses calls
+                results.push_back(measure("negLogLikelihoodKernel", params, minTime, 1, [&]() {
+                    doNotOptimize((fitter.*kernel)(x, hist, pdfLookup, nPulses));
+                }));
+                fitter.prepareRecursiveKernel(xCenters);
+                double nllTable = (fitter.*kernel)(x, hist, pdfLookup, nPulses);
+                double nllRecursive = fitter.negLogLikelihoodRecursive(x, hist, pdfLookup, nPulses);
+                Result r = measure("negLogLikelihoodRecursive", params, minTime, 1, [&]() {
+                    doNotOptimize(fitter.negLogLikelihoodRecursive(x, hist, pdfLookup, nPulses));
+                });
+                r.metrics = {{"nll_rel_diff", fabs(nllRecursive - nllTable) / fabs(nllTable)}};
+                results.push_back(r);
+            }
+            if (wanted("fitPulses")) {
+                vector<double> fittedPEs, fittedDTs;
+                double fitNLL;
+                results.push_back(measure("fitPulses", params, minTime, 1, [&]() {
+                    fitter.fitPulses(hist, xCenters, pdfLookup, fittedPEs, fittedDTs, fitNLL);
+                    doNotOptimize(fittedPEs.data());
+                }, [&]() { return fitter.nllEvals_; }));
+
+                fitter.setIncrementalLikelihood(true); // A/B: only the pulses a parameter change moved
+                fitter.incremental_.binsEvaluated = fitter.incremental_.binsTotal = 0;
+                Result r = measure("fitPulsesIncremental", params, minTime, 1, [&]() {
+                    fitter.fitPulses(hist, xCenters, pdfLookup, fittedPEs, fittedDTs, fitNLL);
+                    doNotOptimize(fittedPEs.data());
+                }, [&]() { return fitter.nllEvals_; });
+                if (fitter.incremental_.binsTotal) { // share of bins recomputed (single-pulse fits bypass it)
+                    r.metrics["bins_evaluated"] = double(fitter.incremental_.binsEvaluated) / fitter.incremental_.binsTotal;
+                }
+                results.push_back(r);
+                fitter.setIncrementalLikelihood(false);
+            }
+        }
+    }
+
+    // long windows: truncated kernel (kernel_tolerance) against the full one, speed and accuracy
+    if (wanted("truncatedKernel")) {
+        for (double relTol : {1e-4, 1e-7}) {
+        for (int nBins : {256, 1024}) {
+            for (int nPulses : {2, 8}) {
+                json params = {{"nBins", nBins}, {"nPulses", nPulses}, {"relTol", relTol}};
+                mt19937_64 rng(1000 * nBins + nPulses);
+                vector<double> times = makeWindowTimes(rng, 0.0, nBins, nPulses);
+                vector<int> hist;
+                vector<double> xCenters;
+                double width, start, end;
+                int j;
+                fitter.makeHistogram(times, 0, fitter.binWidth_, width, j, start, end, hist, xCenters);
+                vector<vector<double>> pdfLookup = fitter.generatePDFLookup(xCenters);
+                vector<double> x;
+                for (int p = 0; p < nPulses; ++p) x.push_back(30.0);
+                for (int p = 0; p < nPulses; ++p) x.push_back((double)p * hist.size() / nPulses);
+
+                fitter.setKernelTolerance(relTol);
+                if (!fitter.prepareSparseKernel(hist, pdfLookup)) continue; // support covers the window: exact
+                Pulse_Fitting::NLLKernel full = Pulse_Fitting::nllKernel(nPulses);
+                double nllFull = (fitter.*full)(x, hist, pdfLookup, nPulses);
+                double nllSparse = fitter.negLogLikelihoodSparse(x, hist, pdfLookup, nPulses);
+
+                Result exact = measure("fullKernel", params, minTime, 1, [&]() {
+                    doNotOptimize((fitter.*full)(x, hist, pdfLookup, nPulses));
+                });
+                Result r = measure("truncatedKernel", params, minTime, 1, [&]() {
+                    doNotOptimize(fitter.negLogLikelihoodSparse(x, hist, pdfLookup, nPulses));
+                });
+                r.metrics = {{"support", fitter.kernelSupport_}, {"full_ns_per_op", exact.nsPerOp},
+                             {"nll_abs_diff", fabs(nllSparse - nllFull)}};
+
+                // whole fit, truncated vs exact: fitted PE per pulse and pulse count
+                vector<double> pe[2], dt[2];
+                double nll[2];
+                bool fallback = false;
+                for (int exact = 0; exact < 2; ++exact) {
+                    fitter.setKernelTolerance(exact ? 0.0 : relTol);
+                    fitter.fitPulses(hist, xCenters, pdfLookup, pe[exact], dt[exact], nll[exact]);
+                    if (!exact) fallback = fitter.lastFit_.kernelFallback; // failed the exact-kernel check
+                }
+                double peDiff = 0.0;
+                for (size_t k = 0; k < min(pe[0].size(), pe[1].size()); ++k) peDiff = max(peDiff, fabs(pe[0][k] - pe[1][k]));
+                r.metrics["fit_pulses"] = {pe[0].size(), pe[1].size()};
+                r.metrics["fit_max_pe_diff"] = peDiff;
+                r.metrics["fit_nll_diff"] = nll[0] - nll[1];
+                r.metrics["fit_kernel_fallback"] = fallback;
+                results.push_back(r);
+            }
+        }
+        }
+        fitter.setKernelTolerance(0.0);
+    }
+
+    // end to end on a generated segment stream: throughput per neutron plus fit accuracy vs truth
+    if (wanted("syntheticRun")) {
+        for (double pileup : {0.0, 0.2}) {
+            SyntheticParams p;
+            p.duration = p.neutronStop = 5.0;
+            p.neutronRate = 200.0;
+            p.pileupFraction = pileup;
+            vector<vector<TruthPulse>> truth;
+            vector<EventList> segments = generateSyntheticRun(p, &truth);
+            Pulse_Fitting run(segments[0]);
+            const vector<TruthPulse>& neutrons = truth[0];
+
+            PulseTable out;
+            Result r = measure("syntheticRun", {{"pileupFraction", pileup}, {"neutronRate", p.neutronRate}},
+                               minTime, neutrons.size(), [&]() {
+                out.clear();
+                run.fitRegion(run.peTimes_, out);
+            }, [&]() { return run.nllEvals_; });
+
+            // each neutron matched to the closest fitted pulse within 2 us
+            vector<pair<double, double>> fitted; // (time us, PE), sorted; pulses within a window are not
+            for (size_t k = 0; k < out.size(); ++k) fitted.emplace_back(out.time[k], out.pe[k]);
+            sort(fitted.begin(), fitted.end());
+            size_t matched = 0;
+            double peBias = 0.0;
+            for (const auto& n : neutrons) {
+                double t = n.time * 1e6;
+                auto it = lower_bound(fitted.begin(), fitted.end(), make_pair(t - 2.0, 0.0));
+                auto best = fitted.end();
+                for (; it != fitted.end() && it->first <= t + 2.0; ++it) {
+                    if (best == fitted.end() || fabs(it->first - t) < fabs(best->first - t)) best = it;
+                }
+                if (best == fitted.end()) continue;
+                ++matched;
+                peBias += best->second - n.pe;
+            }
+            r.metrics = {{"neutrons", neutrons.size()}, {"fitted", out.size()},
+                         {"efficiency", neutrons.empty() ? 0.0 : double(matched) / neutrons.size()},
+                         {"pe_bias", matched ? peBias / matched : 0.0}};
+            results.push_back(r);
+        }
+    }
+    return results;
+}
+
+// recorded windows straight into fitPulses: real window-length and pileup mix, no ROOT I/O
+vector<Result> Pulse_Bench::replay(const vector<CorpusWindow>& windows, double minTime) {
+    EventList noEvents;
+    Pulse_Fitting fitter(noEvents);
+
+    vector<vector<double>> centers(windows.size());
+    vector<size_t> lengths;
+    for (size_t w = 0; w < windows.size(); ++w) {
+        for (size_t b = 0; b < windows[w].hist.size(); ++b) centers[w].push_back(b * windows[w].binWidth);
+        lengths.push_back(windows[w].hist.size());
+    }
+    sort(lengths.begin(), lengths.end());
+
+    size_t fitted = 0, pulses = 0, multi = 0;
+    Result r = measure("replay", {{"windows", windows.size()}}, minTime, windows.size(), [&]() {
+        fitted = pulses = multi = 0;
+        vector<double> fittedPEs, fittedDTs;
+        double fitNLL;
+        for (size_t w = 0; w < windows.size(); ++w) {
+            const vector<vector<double>>& pdfLookup = fitter.generatePDFLookup(centers[w]);
+            if (fitter.fitPulses(windows[w].hist, centers[w], pdfLookup, fittedPEs, fittedDTs, fitNLL)) {
+                ++fitted;
+                pulses += fittedPEs.size();
+                multi += fittedPEs.size() > 1;
+            }
+            if (fitter.pdfCache_.size() > 500) fitter.pdfCache_.clear(); // same policy as fitRegion
+        }
+    }, [&]() { return fitter.nllEvals_; });
+
+    size_t n = lengths.size();
+    r.metrics = {{"fitted_windows", fitted}, {"pulses", pulses}, {"multi_pulse_windows", multi},
+                 {"nbins_p50", n ? lengths[n / 2] : 0}, {"nbins_p95", n ? lengths[n * 95 / 100] : 0},
+                 {"nbins_max", n ? lengths.back() : 0}};
+
+    // the same windows through a fresh fit memo per pass: what one job gains from repeated histograms
+    const int memoMaxBins = 16;
+    Fit_Memo::Stats memoStats = {};
+    Result rm = measure("replayMemo", {{"windows", windows.size()}, {"maxBins", memoMaxBins}}, minTime, windows.size(), [&]() {
+        Fit_Memo memo(64 << 20, memoMaxBins);
+        fitter.setFitMemo(&memo);
+        vector<double> fittedPEs, fittedDTs;
+        double fitNLL;
+        for (size_t w = 0; w < windows.size(); ++w) {
+            const vector<vector<double>>& pdfLookup = fitter.generatePDFLookup(centers[w]);
+            fitter.fitPulses(windows[w].hist, centers[w], pdfLookup, fittedPEs, fittedDTs, fitNLL);
+            if (fitter.pdfCache_.size() > 500) fitter.pdfCache_.clear();
+        }
+        fitter.setFitMemo(nullptr);
+        memoStats = memo.stats();
+    }, [&]() { return fitter.nllEvals_; });
+    rm.metrics = {{"lookups", memoStats.lookups}, {"hits", memoStats.hits},
+                  {"hit_rate", memoStats.lookups ? double(memoStats.hits) / memoStats.lookups : 0.0},
+                  {"memo_bytes", memoStats.bytes}};
+
+    // the same windows with a fit table (built here, as Make_Fit_Table does): tiny windows skip NLopt
+    const int tableMaxBins = 6, tableMaxCounts = 12;
+    Fit_Table table;
+    Pulse_Fitting tableFitter(noEvents);
+    table.build(tableFitter, tableMaxBins, tableMaxCounts, false);
+    size_t tableHits = 0;
+    Result rt = measure("replayTable", {{"windows", windows.size()}, {"maxBins", tableMaxBins}, {"maxCounts", tableMaxCounts}},
+                        minTime, windows.size(), [&]() {
+        fitter.setFitTable(&table);
+        uint64_t before = table.hits();
+        vector<double> fittedPEs, fittedDTs;
+        double fitNLL;
+        for (size_t w = 0; w < windows.size(); ++w) {
+            const vector<vector<double>>& pdfLookup = fitter.generatePDFLookup(centers[w]);
+            fitter.fitPulses(windows[w].hist, centers[w], pdfLookup, fittedPEs, fittedDTs, fitNLL);
+            if (fitter.pdfCache_.size() > 500) fitter.pdfCache_.clear();
+        }
+        fitter.setFitTable(nullptr);
+        tableHits = table.hits() - before;
+    }, [&]() { return fitter.nllEvals_; });
+    rt.metrics = {{"hits", tableHits}, {"hit_rate", double(tableHits) / windows.size()}, {"table_windows", table.size()}};
+    return {r, rm, rt};
+}
+
+int main(int argc, char **argv) {
+    string filter, outPath, corpusPath;
+    double minTime = 0.5; // seconds per benchmark (split over 5 repetitions)
+    for (int a = 1; a < argc; ++a) {
+        string arg = argv[a];
+        if (arg == "--filter" && a + 1 < argc) filter = argv[++a];
+        else if (arg == "--min-time" && a + 1 < argc) minTime = stod(argv[++a]);
+        else if (arg == "--out" && a + 1 < argc) outPath = argv[++a];
+        else if (arg == "--corpus" && a + 1 < argc) corpusPath = argv[++a];
+        else if (arg == "--perf") g_perf = &threadPerfCounters();
+        else {
+            cerr << "Usage: Pulse_Bench [--filter <substring>] [--min-time <s>] [--out <file.json>] [--corpus <windows.gz>] [--perf]" << endl;
+            return 1;
+        }
+    }
+
+    if (g_perf && !g_perf->ok()) {
+        cerr << "Hardware counters unavailable (" << g_perf->error() << "), continuing without --perf" << endl;
+        g_perf = nullptr;
+    }
+
+    allocTracking_ = true; // allocs/op and bytes/op via the Alloc_Tracker hook
+    vector<Result> results;
+    if (corpusPath.empty()) {
+        results = Pulse_Bench::runAll(filter, minTime);
+    } else {
+        vector<CorpusWindow> windows;
+        if (!readWindowCorpus(corpusPath, windows)) return 1;
+        if (windows.empty()) {
+            cerr << "Window corpus " << corpusPath << " holds no windows" << endl;
+            return 1;
+        }
+        results = Pulse_Bench::replay(windows, minTime);
+    }
+
+    // stable layout for diffing across commits: fixed benchmark order, sorted keys
+    json report;
+    report["schema"] = 1;
+    report["commit"] = BENCH_COMMIT;
+    report["min_time_s"] = minTime;
+    if (!corpusPath.empty()) report["corpus"] = corpusPath;
+    report["benchmarks"] = json::array();
+    for (const auto& r : results) {
+        json b = {{"name", r.name}, {"params", r.params}, {"ns_per_op", r.nsPerOp},
+                  {"allocs_per_op", r.allocsPerOp}, {"bytes_per_op", r.bytesPerOp}};
+        if (r.evalsPerFit >= 0) b["evals_per_fit"] = r.evalsPerFit;
+        if (!r.metrics.empty()) b["metrics"] = r.metrics;
+        if (!r.counters.empty()) b["counters"] = r.counters;
+        report["benchmarks"].push_back(b);
+        cerr << r.name << " " << r.params.dump() << ": " << r.nsPerOp << " ns/op, "
+             << r.allocsPerOp << " allocs/op" << (r.evalsPerFit >= 0 ? ", " + to_string(r.evalsPerFit) + " evals/fit" : "") << endl;
+    }
+
+    if (outPath.empty()) {
+        cout << report.dump(2) << endl;
+    } else {
+        ofstream out(outPath);
+        out << report.dump(2) << endl;
+    }
+    return 0;
+}
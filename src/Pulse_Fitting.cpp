@@ -1,8 +1,11 @@
 #include "Pulse_Fitting.h"
+#include "Stage_Timer.h"
+#include "Trace.h"
 #include <numeric>
 #include <algorithm>
 #include <nlopt.hpp>
 #include <iostream>
+#include <chrono>
 
 using namespace std;
 
@@ -15,6 +18,10 @@ std::vector<double> makeLogFactorialTable(int max_k) {
     return table;
 }
 
+const uint32_t Pulse_Fitting::kFitVersion;
+const int Pulse_Fitting::kMinPE;
+constexpr double Pulse_Fitting::kKernelCheckNLL;
+
 PDFParams pdfParams_ = {
     1.09453333e+03,
     5.32077446e+03,
@@ -43,14 +50,70 @@ void Pulse_Fitting::setBackgroundWindow(double start_us) {
     backgroundAfterUs_ = start_us;
 }
 
-void Pulse_Fitting::analyze() { // Assume 60s is the length for both the counting and the background windows
-    cout << "Event size: " << peTimes_.size() << endl; // total PE hits loaded
+void Pulse_Fitting::setTelemetry(Fit_Telemetry* telemetry, const string& segment) {
+    telemetry_ = telemetry;
+    telemetrySegment_ = segment;
+}
+
+void Pulse_Fitting::setKernelTolerance(double relTol) {
+    kernelTolerance_ = relTol;
+}
+
+void Pulse_Fitting::setRecursiveKernel(bool on) {
+    recursiveKernel_ = on;
+}
+
+void Pulse_Fitting::setIncrementalLikelihood(bool on) {
+    incrementalLikelihood_ = on;
+}
+
+void Pulse_Fitting::setFitMemo(Fit_Memo* memo) {
+    memo_ = memo;
+}
+
+void Pulse_Fitting::setFitTable(const Fit_Table* table) {
+    fitTable_ = table;
+}
+
+void Pulse_Fitting::setWindowTriage(bool on) {
+    windowTriage_ = on;
+}
+
+int Pulse_Fitting::minSplitBins(double binWidth, double minGap) {
+    // a core shorter than the overlap on its two sides would be a sliver inside a much longer part
+    return max(static_cast<int>(ceil(2.0 * splitOverlap(minGap) / binWidth)), 2);
+}
+
+bool Pulse_Fitting::setWindowSplitting(int maxBins) {
+    int minBins = minSplitBins(binWidth_, minGap_);
+    if (maxBins > 0 && maxBins < minBins) {
+        cerr << "Error: split_window_bins " << maxBins << " is below the minimum " << minBins
+             << " (twice the part overlap), window splitting stays off" << endl;
+        splitBins_ = 0;
+        return false;
+    }
+    splitBins_ = max(maxBins, 0);
+    return true;
+}
 
-    vector<double> signalTimes = applyTimeWindow(peTimes_, startAfterUs_, stopAfterUs_);
-    vector<double> backgroundTimes;
+void Pulse_Fitting::setCorpus(Window_Corpus* corpus, int run, const string& segment) {
+    corpus_ = corpus;
+    corpusRun_ = run;
+    corpusSegment_ = segment;
+}
 
-    if (backgroundAfterUs_ > 0)
-        backgroundTimes = applyTimeWindow(peTimes_, backgroundAfterUs_, backgroundAfterUs_ + 60e6);
+void Pulse_Fitting::analyze() { // Assume 60s is the length for both the counting and the background windows
+    TRACE_SCOPE("analyze", {{"hits", peTimes_.size()}});
+    cout << "Event size: " << peTimes_.size() << endl; // total PE hits loaded
+    stageTotals_.count(stageTotals_.peHits, peTimes_.size());
+
+    vector<double> signalTimes, backgroundTimes;
+    {
+        ScopedStage timer(Stage::TimeExtraction);
+        signalTimes = applyTimeWindow(peTimes_, startAfterUs_, stopAfterUs_);
+        if (backgroundAfterUs_ > 0)
+            backgroundTimes = applyTimeWindow(peTimes_, backgroundAfterUs_, backgroundAfterUs_ + 60e6);
+    }
 
     cout << "SignalTime PE Event size: " << signalTimes.size() << "  |  ";
     cout << "Background PE Event size: " << backgroundTimes.size() << endl;
@@ -67,6 +130,7 @@ void Pulse_Fitting::analyze() { // Assume 60s is the length for both the countin
 
 void Pulse_Fitting::extractTimes(const EventList& events) {
     // linearize event.realtime (s) -> vector of times (us)
+    ScopedStage timer(Stage::TimeExtraction);
     vector<double> times;
     times.reserve(events.size());
     for (const auto& e : events) {
@@ -98,12 +162,28 @@ tuple<double, int, double, double> Pulse_Fitting::movingWindow(const vector<doub
     return make_tuple(windowWidth, j, start, end);
 }
 
+size_t Pulse_Fitting::countWindows(const vector<double>& times) const {
+    // one window per run of hits with no gap > minGap_ (same rule as movingWindow)
+    if (times.empty()) return 0;
+    size_t n = 1;
+    for (size_t k = 1; k < times.size(); ++k) {
+        if (times[k] - times[k - 1] > minGap_) ++n;
+    }
+    return n;
+}
+
 bool Pulse_Fitting::makeHistogram(const vector<double>& times, int i, double binWidth,
                                   double& windowWidth, int& j, double& startTime, double& endTime,
                                   vector<int>& hist, vector<double>& xCenters) 
 {
     // compute [startTime, endTime] window and bin hits into 'hist' with given binWidth
     tie(windowWidth, j, startTime, endTime) = movingWindow(times, i);
+    return fillHistogram(times, i, j, startTime, windowWidth, binWidth, hist, xCenters);
+}
+
+bool Pulse_Fitting::fillHistogram(const vector<double>& times, int i, int j, double startTime, double windowWidth,
+                                  double binWidth, vector<int>& hist, vector<double>& xCenters)
+{
     if (windowWidth < binWidth) return false;
 
     int nBins = static_cast<int>(ceil(windowWidth / binWidth));
@@ -126,37 +206,97 @@ bool Pulse_Fitting::makeHistogram(const vector<double>& times, int i, double bin
     return true;
 }
 
-void Pulse_Fitting::fitRegion(const vector<double>& data_us,
-                              vector<tuple<double, double, int, double, bool>>& output) 
+Pulse_Fitting::Triage Pulse_Fitting::triageWindow(int hits, double windowWidth) const {
+    // narrow: shorter than a coarse bin, which makeHistogram rejects (isolated hits included).
+    // few hits: the window's first hit opens bin 0 and no gradient seed can gather kMinPE hits, so
+    // the model is the single baseline pulse; its kernel is normalized over the window, which puts
+    // the likelihood optimum at dt = 0 with PE = hits < kMinPE, and solvePulses drops it
+    if (windowWidth < binWidth_) return Triage::Narrow;
+    if (windowTriage_ && hits < kMinPE) return Triage::FewHits;
+    return Triage::Keep;
+}
+
+void Pulse_Fitting::fitRegion(const vector<double>& data_us, PulseTable& output) 
 {
     // slide over data, window by window, fit pulses per window
+    TRACE_SCOPE("fitRegion", {{"region", &output == &signalPulses_ ? "signal" : "background"}, {"hits", data_us.size()}});
     int i = 0;
     int N = static_cast<int>(data_us.size());
     int windowCount = 0;
+    bool signal = &output == &signalPulses_;
+    output.reserve(output.size() + countWindows(data_us)); // ~one pulse per window
+    vector<int>& hist = scratch_.hist;
+    vector<double>& xCenters = scratch_.xCenters;
+    vector<double>& fittedPEs = scratch_.fittedPEs;
+    vector<double>& fittedDTs = scratch_.fittedDTs;
     
     while (i < N) {
-        vector<int> hist;
-        vector<double> xCenters;
         double windowWidth, startTime, endTime;
         int j;
-
-        if (!makeHistogram(data_us, i, binWidth_, windowWidth, j, startTime, endTime, hist, xCenters)) {
+        double usedBinWidth = binWidth_;
+        bool split = false;
+        size_t nParts = 0;
+
+        {
+            ScopedStage timer(Stage::WindowSegmentation);
+            tie(windowWidth, j, startTime, endTime) = movingWindow(data_us, i);
+            Triage triage = triageWindow(j - i, windowWidth);
+            if (triage != Triage::Keep) {
+                stageTotals_.count(triage == Triage::Narrow ? stageTotals_.triagedNarrow : stageTotals_.triagedFewHits, 1);
+                i = j;
+                continue;
+            }
+            split = splitBins_ > 0 && windowWidth > splitBins_ * binWidth_;
+            if (split) splitWindow(data_us, i, j, windowWidth, signal, scratch_.splitParts, nParts); // chained pulses
+        }
+        if (split) {
+            vector<BatchWindow>& parts = scratch_.splitParts;
+            parts.resize(nParts);
+            fitBatch(parts); // parts of similar length share kernels
+            emitWindow(parts.data(), parts.size(), signal, output, windowCount);
             i = j;
             continue;
         }
 
-        if (xCenters.size() < 2) {
-            if (!makeHistogram(data_us, i, fineBinWidth_, windowWidth, j, startTime, endTime, hist, xCenters)) {
+        {
+            ScopedStage timer(Stage::WindowSegmentation);
+            bool ok = fillHistogram(data_us, i, j, startTime, windowWidth, binWidth_, hist, xCenters);
+            if (ok && xCenters.size() < 2) {
+                ok = fillHistogram(data_us, i, j, startTime, windowWidth, fineBinWidth_, hist, xCenters);
+                usedBinWidth = fineBinWidth_;
+            }
+            if (!ok) {
                 i = j;
                 continue;
             }
         }
+        stageTotals_.count(stageTotals_.windows, 1); // histogrammed windows (isolated hits are skipped)
+
+        if (corpus_) { // exactly what fitPulses sees, for offline replay
+            corpus_->append(corpusRun_, corpusSegment_, signal, usedBinWidth, startTime, hist);
+        }
 
-        vector<vector<double>> pdfLookup = generatePDFLookup(xCenters); // shifted PDFs cache
+        static const vector<vector<double>> noLookup; // recursive kernel: no tables
+        const vector<vector<double>>* pdfLookup = &noLookup;
+        if (!recursiveKernel_) {
+            ScopedStage timer(Stage::KernelBuild);
+            pdfLookup = &generatePDFLookup(xCenters); // shifted PDFs cache
+        }
 
-        vector<double> fittedPEs, fittedDTs;
+        double fitNLL = 0.0;
 
-        bool success = fitPulses(hist, xCenters, pdfLookup, fittedPEs, fittedDTs);
+        bool success;
+        long evalsBefore = nllEvals_;
+        auto fitStart = telemetry_ ? chrono::steady_clock::now() : chrono::steady_clock::time_point();
+        {
+            ScopedStage timer(Stage::Fitting);
+            success = fitPulses(hist, xCenters, *pdfLookup, fittedPEs, fittedDTs, fitNLL);
+        }
+        if (telemetry_) {
+            double fitUs = chrono::duration<double, micro>(chrono::steady_clock::now() - fitStart).count();
+            telemetry_->record({telemetrySegment_, signal, startTime, static_cast<int>(hist.size()),
+                                usedBinWidth, lastFit_, nllEvals_ - evalsBefore, fitUs});
+        }
         if (!success) {
             i = j;
             continue;
@@ -164,7 +304,7 @@ void Pulse_Fitting::fitRegion(const vector<double>& data_us,
 
         for (size_t k = 0; k < fittedPEs.size(); ++k) {
             double pulse_time_us = startTime + fittedDTs[k] * (xCenters[1] - xCenters[0]);
-            output.emplace_back(pulse_time_us, fittedPEs[k], windowCount, windowWidth, fittedPEs.size() > 1); // store result
+            output.push_back(pulse_time_us, fittedPEs[k], windowCount, windowWidth, fittedPEs.size() > 1, fitNLL); // store result
             // cout << (double)j/(double)N << ", " << pulse_time_us / 1e6 << ", " << fittedPEs[k] << ", " << endl;
         }
 
@@ -177,6 +317,161 @@ void Pulse_Fitting::fitRegion(const vector<double>& data_us,
     }
 }
 
+void Pulse_Fitting::emitWindow(const BatchWindow* parts, size_t n, bool signal, PulseTable& output, int& windowCount) {
+    // overlapping parts of a split window each keep the pulses inside their own core, so every
+    // stretch of the window reports the fit that saw it with context on both sides. A pulse close
+    // to a cut can be fitted by both neighbours a little to either side of it: pulses of adjacent
+    // parts within one bin of each other are one pulse, taken from the part that has it nearer its
+    // middle, whichever core it landed in. Closest pairs are matched first, each pulse at most once,
+    // so a pulse lying between the two fits of another does not hide the pair
+    vector<PartPulse>& pulses = scratch_.partPulses;
+    pulses.clear();
+    for (size_t p = 0; p < n; ++p) {
+        const BatchWindow& w = parts[p];
+        if (telemetry_) {
+            telemetry_->record({telemetrySegment_, signal, w.startTime, static_cast<int>(w.hist.size()),
+                                w.binWidth, w.stats, w.evals, w.fitUs});
+        }
+        if (!w.fitted) continue;
+        for (size_t k = 0; k < w.pe.size(); ++k) {
+            double t = w.startTime + w.dt[k] * w.binWidth;
+            if (t >= w.keepFrom - w.binWidth && t < w.keepTo + w.binWidth) {
+                pulses.push_back({t, static_cast<int>(p), static_cast<int>(k), t >= w.keepFrom && t < w.keepTo, false, false});
+            }
+        }
+    }
+    if (n > 1) {
+        stable_sort(pulses.begin(), pulses.end(), [](const PartPulse& x, const PartPulse& y) { return x.t < y.t; });
+        auto offCentre = [&](const PartPulse& q) {
+            const BatchWindow& w = parts[q.part];
+            return fabs(q.t - (w.startTime + 0.5 * w.hist.size() * w.binWidth));
+        };
+        vector<pair<double, pair<int, int>>>& pairs = scratch_.mergePairs;
+        pairs.clear();
+        for (size_t a = 0; a < pulses.size(); ++a) {
+            for (size_t b = a + 1; b < pulses.size() && pulses[b].t - pulses[a].t <= parts[pulses[a].part].binWidth; ++b) {
+                if (abs(pulses[a].part - pulses[b].part) == 1) {
+                    pairs.push_back({pulses[b].t - pulses[a].t, {static_cast<int>(a), static_cast<int>(b)}});
+                }
+            }
+        }
+        sort(pairs.begin(), pairs.end());
+        for (const auto& pr : pairs) {
+            PartPulse& x = pulses[pr.second.first];
+            PartPulse& y = pulses[pr.second.second];
+            if (x.paired || y.paired) continue;
+            x.paired = y.paired = true;
+            bool keepX = offCentre(x) <= offCentre(y);
+            (keepX ? x : y).keep = true; // the merged pulse is kept wherever it landed
+            (keepX ? y : x).merged = true;
+        }
+    }
+    size_t kept = 0;
+    for (const PartPulse& q : pulses) kept += q.keep && !q.merged;
+    if (kept == 0) return;
+
+    for (const PartPulse& q : pulses) {
+        if (!q.keep || q.merged) continue;
+        const BatchWindow& w = parts[q.part];
+        output.push_back(q.t, w.pe[q.k], windowCount, w.windowWidth, kept > 1, w.nll);
+    }
+    windowCount++;
+}
+
+double Pulse_Fitting::splitOverlap(double minGap) {
+    return max(minGap, 3.0 * pdfParams_.scale3); // slowest decay 95% spent
+}
+
+void Pulse_Fitting::splitWindow(const vector<double>& times, int i, int j, double windowWidth, bool signal,
+                                vector<BatchWindow>& parts, size_t& nParts) {
+    // cores of at most splitBins_ coarse bins, each cut in the emptiest bin of its second half;
+    // every part extends 'overlap' past its core on both sides, so the tails of pulses on either
+    // side of a cut are in view, and keeps only what it fits inside the core (see emitWindow)
+    double start = times[i];
+    int nBins = static_cast<int>(ceil(windowWidth / binWidth_));
+    vector<int>& counts = scratch_.splitCounts;
+    counts.assign(nBins + 1, 0);
+    for (int k = i; k < j; ++k) counts[min(static_cast<int>((times[k] - start) / binWidth_), nBins)]++;
+
+    const double inf = numeric_limits<double>::infinity();
+    const double overlap = splitOverlap(minGap_);
+    int a = 0; // first bin of the current core
+    while (true) {
+        int c = nBins + 1; // one past the last core
+        if (nBins + 1 - a > splitBins_) {
+            int lo = a + max(1, splitBins_ / 2);
+            c = lo;
+            for (int b = lo + 1; b <= a + splitBins_; ++b) {
+                if (counts[b] <= counts[c]) c = b; // latest emptiest bin: longest core
+            }
+        }
+        double coreFrom = a == 0 ? -inf : start + a * binWidth_;
+        double coreTo = c > nBins ? inf : start + c * binWidth_;
+
+        // the part's hits: core plus overlap on either side, starting at a hit as movingWindow does
+        int k0 = static_cast<int>(lower_bound(times.begin() + i, times.begin() + j, coreFrom - overlap) - times.begin());
+        int k1 = static_cast<int>(upper_bound(times.begin() + k0, times.begin() + j, coreTo + overlap) - times.begin());
+        double partWidth = k1 > k0 ? times[k1 - 1] - times[k0] : 0.0;
+        if (k1 > k0 && triageWindow(k1 - k0, partWidth) == Triage::Keep) {
+            if (nParts == parts.size()) parts.emplace_back();
+            BatchWindow& w = parts[nParts];
+            if (fillHistogram(times, k0, k1, times[k0], partWidth, binWidth_, w.hist, scratch_.xCenters)
+                && w.hist.size() >= 2) {
+                w.binWidth = binWidth_;
+                w.startTime = times[k0];
+                w.windowWidth = windowWidth; // output reports the whole window
+                w.keepFrom = coreFrom;
+                w.keepTo = coreTo;
+                ++nParts;
+                stageTotals_.count(stageTotals_.windows, 1);
+                if (corpus_) corpus_->append(corpusRun_, corpusSegment_, signal, binWidth_, w.startTime, w.hist);
+            }
+        }
+        if (c > nBins) break;
+        a = c;
+    }
+}
+
+void Pulse_Fitting::fitBatch(vector<BatchWindow>& windows) {
+    // windows with the same (nBins, binWidth) share xCenters and the kernel: set those up once per
+    // group and fit the group back to back; results are the same as fitting the windows one by one
+    TRACE_SCOPE("fitBatch", {{"windows", windows.size()}});
+    vector<size_t>& order = scratch_.batchOrder;
+    order.resize(windows.size());
+    iota(order.begin(), order.end(), 0);
+    auto shape = [&](size_t k) { return make_pair(windows[k].hist.size(), windows[k].binWidth); };
+    stable_sort(order.begin(), order.end(), [&](size_t a, size_t b) { return shape(a) < shape(b); });
+
+    static const vector<vector<double>> noLookup;
+    const vector<vector<double>>* pdfLookup = &noLookup;
+    vector<double>& xCenters = scratch_.xCenters;
+    for (size_t a = 0; a < order.size(); ++a) {
+        BatchWindow& w = windows[order[a]];
+        if (a == 0 || shape(order[a]) != shape(order[a - 1])) { // next group
+            int nBins = static_cast<int>(w.hist.size());
+            xCenters.resize(nBins);
+            for (int b = 0; b < nBins; ++b) xCenters[b] = b * w.binWidth; // as makeHistogram
+            if (!recursiveKernel_) {
+                ScopedStage timer(Stage::KernelBuild);
+                if (pdfCache_.size() > 500) { // the previous group's kernel is done with: trim as fitRegion does
+                    pdfCache_.clear();
+                }
+                pdfLookup = &generatePDFLookup(xCenters);
+            }
+        }
+
+        long evalsBefore = nllEvals_;
+        auto fitStart = telemetry_ ? chrono::steady_clock::now() : chrono::steady_clock::time_point();
+        {
+            ScopedStage timer(Stage::Fitting);
+            w.fitted = fitPulses(w.hist, xCenters, *pdfLookup, w.pe, w.dt, w.nll);
+        }
+        if (telemetry_) w.fitUs = chrono::duration<double, micro>(chrono::steady_clock::now() - fitStart).count();
+        w.stats = lastFit_;
+        w.evals = nllEvals_ - evalsBefore;
+    }
+}
+
 vector<double> Pulse_Fitting::analyticPDF(const vector<double>& x, int shift) {
     // tri-exponential impulse response over bin center x; normalized to 1
     double r1 = pdfParams_.ratio1;
@@ -218,9 +513,10 @@ vector<double> Pulse_Fitting::analyticPDF(const vector<double>& x, int shift) {
     return pdf;
 }
 
-vector<vector<double>> Pulse_Fitting::generatePDFLookup(const vector<double>& xCenters) {
+const vector<vector<double>>& Pulse_Fitting::generatePDFLookup(const vector<double>& xCenters) {
     // build matrix: for each integer shift dx, a shifted PDF over bins
-    if (xCenters.size() < 2) return {};
+    static const vector<vector<double>> empty;
+    if (xCenters.size() < 2) return empty;
     int length = static_cast<int>(xCenters.size());
 
     double binWidth = xCenters[1] - xCenters[0];
@@ -239,21 +535,22 @@ vector<vector<double>> Pulse_Fitting::generatePDFLookup(const vector<double>& xC
         }
     }
 
-    pdfCache_[key] = pdfLookup;
-    return pdfLookup;
+    return pdfCache_.emplace(key, move(pdfLookup)).first->second;
+}
+
+static inline double poissonTerm(int k, double lam) {
+    // k*log(lam) - lam - log(k!); Stirling for large k
+    if (k < 20) {
+        return k * log(lam) - lam - log_fact_table[k];
+    }
+    return k * log(lam) - lam - (k * log(k) - k + 0.5 * log(2 * M_PI * k));
 }
 
 double Pulse_Fitting::poissonLogLikelihood(const vector<int>& observed, const vector<double>& expected) {
-    // logL = sum_k [ k*log(lam) - lam - log(k!) ]; Stirling for large k
+    // logL = sum_k [ k*log(lam) - lam - log(k!) ]
     double logL = 0.0;
     for (size_t i = 0; i < observed.size(); ++i) {
-        double lam = expected[i] + 1e-10;
-        int k = observed[i];
-        if (k < 20) {
-            logL += k * log(lam) - lam - log_fact_table[k];
-        } else {
-            logL += k * log(lam) - lam - (k * log(k) - k + 0.5 * log(2 * M_PI * k));
-        }
+        logL += poissonTerm(observed[i], expected[i] + 1e-10);
     }
     return logL;
 }
@@ -262,7 +559,9 @@ double Pulse_Fitting::negLogLikelihood(const vector<double>& params, const vecto
                                         const vector<vector<double>>& pdfLookup, int nPulses) 
 {
     // params = [PE_0..PE_{n-1}, dt_0..dt_{n-1}] ; expected = sum_i PE_i * shiftedPDF(dt_i)
-    vector<double> expected(observed.size(), 0.0);
+    ++nllEvals_;
+    vector<double>& expected = scratch_.expected;
+    expected.assign(observed.size(), 0.0);
     for (int i = 0; i < nPulses; ++i) {
         double PE = params[i];
         int dt = static_cast<int>(params[nPulses + i]);
@@ -273,13 +572,241 @@ double Pulse_Fitting::negLogLikelihood(const vector<double>& params, const vecto
     return -poissonLogLikelihood(observed, expected);
 }
 
-vector<int> Pulse_Fitting::findGradientPeaks(const vector<int>& hist, double thresholdFactor, int ignoreIdx) {
+template <int N>
+double Pulse_Fitting::negLogLikelihoodN(const vector<double>& params, const vector<int>& observed,
+                                        const vector<vector<double>>& pdfLookup, int)
+{
+    // one pass over the bins: expected[j] is summed pulse by pulse exactly as in negLogLikelihood,
+    // so the result is bit-identical, but without the model buffer or the runtime pulse loop
+    ++nllEvals_;
+    double PE[N];
+    const double* pdf[N];
+    for (int i = 0; i < N; ++i) {
+        PE[i] = params[i];
+        pdf[i] = pdfLookup[static_cast<int>(params[N + i])].data();
+    }
+    double logL = 0.0;
+    size_t nBins = observed.size();
+    for (size_t j = 0; j < nBins; ++j) {
+        double lam = 0.0;
+        for (int i = 0; i < N; ++i) lam += PE[i] * pdf[i][j]; // N is constant: unrolled
+        logL += poissonTerm(observed[j], lam + 1e-10);
+    }
+    return -logL;
+}
+
+bool Pulse_Fitting::prepareSparseKernel(const vector<int>& hist, const vector<vector<double>>& pdfLookup) {
+    // support = bins up to the last one at or above kernelTolerance_ x the kernel peak
+    if (kernelTolerance_ <= 0 || pdfLookup.empty()) return false;
+    const vector<double>& pdf = pdfLookup[0];
+    double cut = kernelTolerance_ * *max_element(pdf.begin(), pdf.end());
+    int last = static_cast<int>(pdf.size()) - 1;
+    while (last > 0 && pdf[last] < cut) --last;
+    kernelSupport_ = last + 1;
+    kernelFloor_ = cut;
+    if (kernelSupport_ >= static_cast<int>(hist.size())) return false; // nothing to skip
+
+    // the expectation is constant across a gap, so its Poisson terms only need the hit count and
+    // the sum of log(k!) there: sum_j poissonTerm(k_j, lam) = K log(lam) - n lam - sum_j log(k_j!)
+    vector<double>& counts = scratch_.countPrefix;
+    vector<double>& logFact = scratch_.logFactPrefix;
+    counts.resize(hist.size() + 1);
+    logFact.resize(hist.size() + 1);
+    counts[0] = logFact[0] = 0.0;
+    for (size_t j = 0; j < hist.size(); ++j) {
+        counts[j + 1] = counts[j] + hist[j];
+        logFact[j + 1] = logFact[j] - poissonTerm(hist[j], 1.0) - 1.0; // same Stirling switch as the spans
+    }
+    return true;
+}
+
+double Pulse_Fitting::negLogLikelihoodSparse(const vector<double>& params, const vector<int>& observed,
+                                             const vector<vector<double>>& pdfLookup, int nPulses)
+{
+    // a pulse contributes its kernel inside [dt, dt + support) and the truncation level
+    // kernelFloor_ x PE after it, an upper bound on the tail that was cut, so a late hit costs
+    // what the tolerance allows rather than log(1e-10); gaps between spans then have a constant
+    // expectation and come from the prefix sums, the Poisson term is evaluated only inside spans
+    ++nllEvals_;
+    int nBins = static_cast<int>(observed.size());
+    vector<pair<int, int>>& spans = scratch_.spans;
+    vector<int>& order = scratch_.spanPulse;
+    spans.clear();
+    order.resize(nPulses);
+    for (int i = 0; i < nPulses; ++i) {
+        int dt = static_cast<int>(params[nPulses + i]);
+        spans.emplace_back(dt, min(dt + kernelSupport_, nBins));
+        order[i] = i;
+    }
+    sort(order.begin(), order.end(), [&](int a, int b) { return spans[a].first < spans[b].first; });
+
+    // walk the bins left to right; the pulses active at bin j are those with dt <= j < end, and
+    // since spans all have the same length they start and stop in dt order
+    const vector<double>& counts = scratch_.countPrefix;
+    const vector<double>& logFact = scratch_.logFactPrefix;
+    double logL = 0.0;
+    double spentPE = 0.0; // pulses whose span ended: they stay at the floor
+    size_t first = 0, next = 0; // active pulses are order[first..next)
+    int j = 0;
+    while (j < nBins) {
+        while (first < next && spans[order[first]].second <= j) spentPE += params[order[first++]];
+        double floor = kernelFloor_ * spentPE + 1e-10;
+        if (first == next) {
+            int gapEnd = next < order.size() ? max(j, spans[order[next]].first) : nBins;
+            logL += (counts[gapEnd] - counts[j]) * log(floor) - (gapEnd - j) * floor
+                    - (logFact[gapEnd] - logFact[j]);
+            j = gapEnd;
+            if (j == nBins) break;
+        }
+        while (next < order.size() && spans[order[next]].first <= j) ++next;
+        int stop = nBins; // next bin where the active set changes
+        if (next < order.size()) stop = min(stop, spans[order[next]].first);
+        for (size_t a = first; a < next; ++a) stop = min(stop, spans[order[a]].second);
+
+        for (; j < stop; ++j) {
+            double lam = floor;
+            for (size_t a = first; a < next; ++a) {
+                int i = order[a];
+                lam += params[i] * pdfLookup[spans[i].first][j];
+            }
+            logL += poissonTerm(observed[j], lam);
+        }
+    }
+    return -logL;
+}
+
+void Pulse_Fitting::prepareRecursiveKernel(const vector<double>& xCenters) {
+    // same mixture and normalization as analyticPDF(xCenters), factored per component
+    const double w[3] = {pdfParams_.ratio1, pdfParams_.ratio2, pdfParams_.ratio3};
+    const double s[3] = {pdfParams_.scale1, pdfParams_.scale2, pdfParams_.scale3};
+    double R = w[0] + w[1] + w[2];
+    double loc = pdfParams_.loc;
+    int n = static_cast<int>(xCenters.size());
+    double binWidth = xCenters[1] - xCenters[0];
+
+    int offset = 0;
+    while (offset < n && xCenters[offset] < loc) ++offset;
+    double t0 = offset < n ? xCenters[offset] : 0.0;
+
+    double sum = 0.0;
+    for (int c = 0; c < 3; ++c) {
+        expKernel_.amp[c] = w[c] / R * exp(-(t0 - loc) / s[c]) / s[c];
+        expKernel_.decay[c] = exp(-binWidth / s[c]);
+        sum += expKernel_.amp[c] * (1.0 - pow(expKernel_.decay[c], n - offset)) / (1.0 - expKernel_.decay[c]);
+    }
+    if (sum > 0) {
+        for (double& a : expKernel_.amp) a /= sum;
+    }
+    expKernel_.offset = offset;
+}
+
+double Pulse_Fitting::negLogLikelihoodRecursive(const vector<double>& params, const vector<int>& observed,
+                                                const vector<vector<double>>&, int nPulses)
+{
+    // each component c carries state[c] = sum over started pulses of PE * amp[c] * decay[c]^(j - start)
+    ++nllEvals_;
+    int nBins = static_cast<int>(observed.size());
+    vector<double>& inject = scratch_.expected; // PE of the pulses starting at each bin
+    inject.assign(nBins, 0.0);
+    for (int i = 0; i < nPulses; ++i) {
+        int start = static_cast<int>(params[nPulses + i]) + expKernel_.offset;
+        if (start < nBins) inject[start] += params[i];
+    }
+
+    const double* amp = expKernel_.amp;
+    const double* decay = expKernel_.decay;
+    double state0 = 0.0, state1 = 0.0, state2 = 0.0;
+    double logL = 0.0;
+    for (int j = 0; j < nBins; ++j) {
+        state0 = state0 * decay[0] + inject[j] * amp[0];
+        state1 = state1 * decay[1] + inject[j] * amp[1];
+        state2 = state2 * decay[2] + inject[j] * amp[2];
+        logL += poissonTerm(observed[j], state0 + state1 + state2 + 1e-10);
+    }
+    return -logL;
+}
+
+double Pulse_Fitting::negLogLikelihoodIncremental(const vector<double>& params, const vector<int>& observed,
+                                                  const vector<vector<double>>& pdfLookup, int nPulses)
+{
+    // each pulse's contribution to every occupied bin is cached, so a call only redoes the pulses
+    // whose PE or shift changed, and only the occupied bins they reach get a new Poisson term; the
+    // sum over pulses runs in pulse order, so those terms are bit-identical to negLogLikelihood's.
+    // An empty bin's term is -lam: all of them together are -sum_i PE_i x (kernel mass of pulse i
+    // on empty bins), kept per pulse, which matches the full kernel up to rounding
+    ++nllEvals_;
+    IncrementalNLL& c = incremental_;
+    int nBins = static_cast<int>(observed.size());
+    vector<int>& occupied = c.occupied;
+    bool fresh = !c.valid;
+    if (fresh) {
+        occupied.clear();
+        for (int j = 0; j < nBins; ++j) {
+            if (observed[j] > 0) occupied.push_back(j);
+        }
+        const vector<double>& base = pdfLookup[0]; // every row is this kernel shifted by dt
+        c.massPrefix.resize(nBins + 1);
+        c.massPrefix[0] = 0.0;
+        for (int m = 0; m < nBins; ++m) c.massPrefix[m + 1] = c.massPrefix[m] + base[m];
+        c.contrib.assign(occupied.size() * nPulses, 0.0);
+        c.terms.resize(occupied.size());
+        c.emptyMass.assign(nPulses, 0.0);
+        c.params.assign(params.begin(), params.end());
+        c.valid = true;
+    }
+
+    size_t nOcc = occupied.size();
+    size_t lo = fresh ? 0 : nOcc; // first occupied bin whose expectation changed
+    for (int i = 0; i < nPulses; ++i) {
+        int dtOld = static_cast<int>(c.params[nPulses + i]);
+        int dtNew = static_cast<int>(params[nPulses + i]);
+        if (!fresh && c.params[i] == params[i] && dtOld == dtNew) continue;
+        size_t oOld = lower_bound(occupied.begin(), occupied.end(), dtOld) - occupied.begin();
+        size_t oNew = lower_bound(occupied.begin(), occupied.end(), dtNew) - occupied.begin();
+        for (size_t o = min(oOld, oNew); o < oNew; ++o) c.contrib[o * nPulses + i] = 0.0; // now before the pulse
+        const double* row = pdfLookup[dtNew].data();
+        double occupiedMass = 0.0;
+        for (size_t o = oNew; o < nOcc; ++o) {
+            double v = row[occupied[o]];
+            c.contrib[o * nPulses + i] = params[i] * v;
+            occupiedMass += v;
+        }
+        c.emptyMass[i] = params[i] * (c.massPrefix[nBins - dtNew] - occupiedMass);
+        lo = min(lo, min(oOld, oNew));
+    }
+    c.params.assign(params.begin(), params.end());
+    c.binsEvaluated += nOcc - lo;
+    c.binsTotal += nBins;
+
+    for (size_t o = lo; o < nOcc; ++o) {
+        const double* contrib = &c.contrib[o * nPulses];
+        double lam = 0.0;
+        for (int i = 0; i < nPulses; ++i) lam += contrib[i];
+        c.terms[o] = poissonTerm(observed[occupied[o]], lam + 1e-10);
+    }
+    double logL = -(nBins - static_cast<double>(nOcc)) * 1e-10;
+    for (size_t o = 0; o < nOcc; ++o) logL += c.terms[o];
+    for (int i = 0; i < nPulses; ++i) logL -= c.emptyMass[i];
+    return -logL;
+}
+
+Pulse_Fitting::NLLKernel Pulse_Fitting::nllKernel(int nPulses) {
+    static const NLLKernel kernels[] = {&Pulse_Fitting::negLogLikelihoodN<1>, &Pulse_Fitting::negLogLikelihoodN<2>,
+                                        &Pulse_Fitting::negLogLikelihoodN<3>, &Pulse_Fitting::negLogLikelihoodN<4>};
+    if (nPulses >= 1 && nPulses <= 4) return kernels[nPulses - 1];
+    return &Pulse_Fitting::negLogLikelihood; // larger pileups
+}
+
+void Pulse_Fitting::findGradientPeaks(const vector<int>& hist, double thresholdFactor, int ignoreIdx,
+                                      vector<int>& peaks) {
     // simple gradient-based seed find; thresholdFactor in units of grad "std"
+    peaks.clear();
     if ((int)hist.size() <= ignoreIdx + 2) {
-        return {};
+        return;
     }
 
-    vector<double> grad(hist.size() - ignoreIdx);
+    vector<double>& grad = scratch_.grad;
+    grad.assign(hist.size() - ignoreIdx, 0.0);
     for (size_t i = ignoreIdx; i + 1 < hist.size(); ++i) {
         grad[i - ignoreIdx] = static_cast<double>(hist[i + 1] - hist[i - 1]) / 2.0;
     }
@@ -289,29 +816,91 @@ vector<int> Pulse_Fitting::findGradientPeaks(const vector<int>& hist, double thr
     double stdGrad = sqrt(sumSq / grad.size());
     double threshold = thresholdFactor * stdGrad;
 
-    vector<int> peaks;
     for (size_t i = 1; i + 1 < grad.size(); ++i) {
         if (grad[i] > threshold) {
             peaks.push_back(static_cast<int>(i));
         }
     }
-    return peaks;
+}
+
+void Pulse_Fitting::buildMemoKey(const vector<int>& hist, double binWidth, string& key) const {
+    // everything solvePulses depends on besides the constants in its body
+    uint8_t recursive = recursiveKernel_;
+    uint8_t incremental = incrementalLikelihood_; // equal to the full kernel only up to rounding
+    key.clear();
+    auto put = [&](const void* p, size_t n) { key.append(static_cast<const char*>(p), n); };
+    put(&kFitVersion, sizeof(kFitVersion));
+    put(&binWidth, sizeof(binWidth));
+    put(&pdfParams_, sizeof(pdfParams_));
+    put(&kernelTolerance_, sizeof(kernelTolerance_));
+    put(&recursive, sizeof(recursive));
+    put(&incremental, sizeof(incremental));
+    put(hist.data(), hist.size() * sizeof(int));
 }
 
 bool Pulse_Fitting::fitPulses(const vector<int>& hist, const vector<double>& xCenters,
                               const vector<vector<double>>& pdfLookup,
-                              vector<double>& fittedPEs, vector<double>& fittedDTs) 
+                              vector<double>& fittedPEs, vector<double>& fittedDTs, double& fitNLL) 
+{
+    // tiny windows were all fitted offline; the table holds exact, non-incremental kernel fits only
+    if (fitTable_ && xCenters.size() >= 2 && kernelTolerance_ == 0.0 && !recursiveKernel_ && !incrementalLikelihood_
+        && fitTable_->lookup(hist, xCenters[1] - xCenters[0], scratch_.memoFit)) {
+        const MemoFit& fit = scratch_.memoFit;
+        fittedPEs.assign(fit.pe.begin(), fit.pe.end());
+        fittedDTs.assign(fit.dt.begin(), fit.dt.end());
+        fitNLL = fit.nll;
+        lastFit_ = fit.stats;
+        lastFit_.tableHit = true;
+        return fit.fitted;
+    }
+
+    // identical small windows (background, low PE) recur: serve repeats from the memo
+    if (!memo_ || xCenters.size() < 2 || static_cast<int>(hist.size()) > memo_->maxBins()) {
+        return solvePulses(hist, xCenters, pdfLookup, fittedPEs, fittedDTs, fitNLL);
+    }
+    string& key = scratch_.memoKey;
+    MemoFit& fit = scratch_.memoFit;
+    buildMemoKey(hist, xCenters[1] - xCenters[0], key);
+    if (memo_->lookup(key, fit)) {
+        fittedPEs.assign(fit.pe.begin(), fit.pe.end());
+        fittedDTs.assign(fit.dt.begin(), fit.dt.end());
+        fitNLL = fit.nll;
+        lastFit_ = fit.stats;
+        lastFit_.memoHit = true;
+        return fit.fitted;
+    }
+    fit.fitted = solvePulses(hist, xCenters, pdfLookup, fittedPEs, fittedDTs, fitNLL);
+    fit.pe.clear(); // outputs of a failed fit are not meaningful
+    fit.dt.clear();
+    if (fit.fitted) {
+        fit.pe.assign(fittedPEs.begin(), fittedPEs.end());
+        fit.dt.assign(fittedDTs.begin(), fittedDTs.end());
+    }
+    fit.nll = fitNLL;
+    fit.stats = lastFit_;
+    memo_->insert(key, fit);
+    return fit.fitted;
+}
+
+bool Pulse_Fitting::solvePulses(const vector<int>& hist, const vector<double>& xCenters,
+                                const vector<vector<double>>& pdfLookup,
+                                vector<double>& fittedPEs, vector<double>& fittedDTs, double& fitNLL) 
 {
     // seed candidates from gradient; then NLOpt (bounded) to fit PE, dt
-    const int minPE = 5;
+    TRACE_SCOPE("fitPulses", {{"nBins", hist.size()}});
+    lastFit_ = WindowFitStats();
+    const int minPE = kMinPE;
     const int window = 5;
     const int ignoreIdx = 3;
 
     // Use separate gradient peak detection function
-    vector<int> peaks = findGradientPeaks(hist, 2.0, ignoreIdx);
+    vector<int>& peaks = scratch_.peaks;
+    findGradientPeaks(hist, 2.0, ignoreIdx, peaks);
 
-    vector<double> peGuess = {20.0};
-    vector<double> dtGuess = {0.0};
+    vector<double>& peGuess = scratch_.peGuess;
+    vector<double>& dtGuess = scratch_.dtGuess;
+    peGuess.assign(1, 20.0);
+    dtGuess.assign(1, 0.0);
     for (int p : peaks) {
         int idx = p + ignoreIdx;
         int start = idx;
@@ -324,39 +913,47 @@ bool Pulse_Fitting::fitPulses(const vector<int>& hist, const vector<double>& xCe
         }
     }
 
-    vector<double> newPE, newDT;
+    // params = [PE..., dt...] of the seeds above threshold
+    vector<double>& params = scratch_.params;
+    params.clear();
     for (size_t i = 0; i < peGuess.size(); ++i) {
-        if (peGuess[i] >= 5) {
-            newPE.push_back(peGuess[i]);
-            newDT.push_back(dtGuess[i]);
-        }
+        if (peGuess[i] >= 5) params.push_back(peGuess[i]);
     }
 
-    if (newPE.empty()) {
+    if (params.empty()) {
         return false;
     }
 
-    int nPulses = static_cast<int>(newPE.size());
-    vector<double> params;
-    params.insert(params.end(), newPE.begin(), newPE.end());
-    params.insert(params.end(), newDT.begin(), newDT.end());
-
-    vector<double> lb, ub;
-    for (int i = 0; i < nPulses; ++i) {
-        lb.push_back(1.0);
-        ub.push_back(300.0);
-    }
-    for (int i = 0; i < nPulses; ++i) {
-        lb.push_back(0.0);
-        ub.push_back(static_cast<double>(xCenters.size() - 1));
+    int nPulses = static_cast<int>(params.size());
+    lastFit_.seeds = nPulses;
+    for (size_t i = 0; i < peGuess.size(); ++i) {
+        if (peGuess[i] >= 5) params.push_back(dtGuess[i]);
     }
 
+    vector<double>& lb = scratch_.lb;
+    vector<double>& ub = scratch_.ub;
+    lb.assign(nPulses, 1.0);
+    ub.assign(nPulses, 300.0);
+    lb.resize(2 * nPulses, 0.0);
+    ub.resize(2 * nPulses, static_cast<double>(xCenters.size() - 1));
+
     nlopt::opt opt(nlopt::LN_BOBYQA, params.size()); // derivative-free local
     opt.set_lower_bounds(lb);
     opt.set_upper_bounds(ub);
 
+    // objective: exponential recurrence (no tables), truncated kernel (long windows), or the full
+    // kernel, incrementally for multi-pulse models
+    bool sparse = !recursiveKernel_ && prepareSparseKernel(hist, pdfLookup);
+    if (recursiveKernel_) prepareRecursiveKernel(xCenters);
+    auto pickKernel = [&](int n) -> NLLKernel {
+        if (recursiveKernel_) return &Pulse_Fitting::negLogLikelihoodRecursive;
+        if (sparse) return &Pulse_Fitting::negLogLikelihoodSparse;
+        if (incrementalLikelihood_ && n > 1) return &Pulse_Fitting::negLogLikelihoodIncremental;
+        return nllKernel(n);
+    };
+    NLLKernel kernel = pickKernel(nPulses);
     auto objective = [&](const vector<double> &x, vector<double> &grad) {
-        return negLogLikelihood(x, hist, pdfLookup, nPulses);
+        return (this->*kernel)(x, hist, pdfLookup, nPulses);
     };
 
     opt.set_min_objective([](const vector<double> &x, vector<double> &grad, void *data) -> double {
@@ -367,17 +964,25 @@ bool Pulse_Fitting::fitPulses(const vector<int>& hist, const vector<double>& xCe
     opt.set_maxeval(200); // iteration cap
 
     double minf;
+    incremental_.valid = false;
     try {
         nlopt::result result = opt.optimize(params, minf);
+        lastFit_.result = static_cast<int>(result);
+        lastFit_.maxeval = result == nlopt::MAXEVAL_REACHED;
     } catch (exception& e) {
+        lastFit_.result = nlopt::FAILURE;
         cerr << "NLopt failed: " << e.what() << endl;
         return false;
     }
 
     fittedPEs.assign(params.begin(), params.begin() + nPulses);
     fittedDTs.assign(params.begin() + nPulses, params.end());
+    fitNLL = minf;
 
-    vector<double> finalPEs, finalDTs;
+    vector<double>& finalPEs = scratch_.finalPEs;
+    vector<double>& finalDTs = scratch_.finalDTs;
+    finalPEs.clear();
+    finalDTs.clear();
     for (size_t i = 0; i < fittedPEs.size(); ++i) {
         if (fittedPEs[i] >= 5) {
             finalPEs.push_back(fittedPEs[i]);
@@ -392,22 +997,22 @@ bool Pulse_Fitting::fitPulses(const vector<int>& hist, const vector<double>& xCe
     if (finalPEs.size() < fittedPEs.size()) {
         // drop sub-threshold pulses and re-fit the reduced model
         int refinedN = static_cast<int>(finalPEs.size());
-        vector<double> refinedParams = finalPEs;
+        lastFit_.refit = true;
+        vector<double>& refinedParams = params; // first solve already copied out
+        refinedParams.assign(finalPEs.begin(), finalPEs.end());
         refinedParams.insert(refinedParams.end(), finalDTs.begin(), finalDTs.end());
 
-        lb.clear(); ub.clear();
-        for (int i = 0; i < refinedN; ++i) {
-            lb.push_back(1.0); ub.push_back(300.0);
-        }
-        for (int i = 0; i < refinedN; ++i) {
-            lb.push_back(0.0); ub.push_back(static_cast<double>(xCenters.size() - 1));
-        }
+        lb.assign(refinedN, 1.0);
+        ub.assign(refinedN, 300.0);
+        lb.resize(2 * refinedN, 0.0);
+        ub.resize(2 * refinedN, static_cast<double>(xCenters.size() - 1));
 
         nlopt::opt opt2(nlopt::LN_BOBYQA, refinedParams.size());
         opt2.set_lower_bounds(lb);
         opt2.set_upper_bounds(ub);
+        NLLKernel refinedKernel = pickKernel(refinedN);
         auto refinedObj = [&](const vector<double> &x, vector<double> &grad) {
-            return negLogLikelihood(x, hist, pdfLookup, refinedN);
+            return (this->*refinedKernel)(x, hist, pdfLookup, refinedN);
         };
 
         opt2.set_min_objective([](const vector<double> &x, vector<double> &grad, void *data) -> double {
@@ -417,12 +1022,16 @@ bool Pulse_Fitting::fitPulses(const vector<int>& hist, const vector<double>& xCe
         opt2.set_xtol_rel(1e-4);
         opt2.set_maxeval(200);
 
+        incremental_.valid = false;
         try {
             double refinedMinf;
-            opt2.optimize(refinedParams, refinedMinf);
+            lastFit_.result = static_cast<int>(opt2.optimize(refinedParams, refinedMinf));
+            lastFit_.maxeval = lastFit_.maxeval || lastFit_.result == nlopt::MAXEVAL_REACHED;
             fittedPEs.assign(refinedParams.begin(), refinedParams.begin() + refinedN);
             fittedDTs.assign(refinedParams.begin() + refinedN, refinedParams.end());
+            fitNLL = refinedMinf;
         } catch (exception& e) {
+            lastFit_.result = nlopt::FAILURE;
             cerr << "Refined NLopt failed: " << e.what() << endl;
             return false;
         }
@@ -431,5 +1040,23 @@ bool Pulse_Fitting::fitPulses(const vector<int>& hist, const vector<double>& xCe
         fittedDTs = finalDTs;
     }
 
+    if (sparse) {
+        // accuracy check of the truncated kernel: where the exact likelihood at its solution
+        // disagrees, the truncation moved the fit, so solve the window again with the full kernel
+        int n = static_cast<int>(fittedPEs.size());
+        params.assign(fittedPEs.begin(), fittedPEs.end());
+        params.insert(params.end(), fittedDTs.begin(), fittedDTs.end());
+        double exactNLL = (this->*nllKernel(n))(params, hist, pdfLookup, n);
+        if (fabs(exactNLL - fitNLL) > kKernelCheckNLL) {
+            double relTol = kernelTolerance_;
+            kernelTolerance_ = 0.0;
+            bool fitted = solvePulses(hist, xCenters, pdfLookup, fittedPEs, fittedDTs, fitNLL);
+            kernelTolerance_ = relTol;
+            lastFit_.kernelFallback = true;
+            return fitted;
+        }
+    }
+
+    lastFit_.pulses = static_cast<int>(fittedPEs.size());
     return true;
 }
\ No newline at end of file
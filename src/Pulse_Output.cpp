@@ -0,0 +1,369 @@
+#include "Pulse_Output.h"
+#include <fstream>
+#include <iostream>
+#include <cstring>
+#include <sstream>
+#include <zlib.h>
+
+using namespace std;
+
+namespace {
+
+const char kMagic[8] = {'U', 'C', 'N', 'P', 'C', 'O', 'L', '1'};
+const uint32_t kVersion = 1;
+const uint32_t kFlagZlib = 1u << 0;
+const size_t kAlign = 64; // chunk alignment for memmap/SIMD access
+
+struct FileHeader {
+    char magic[8];
+    uint32_t version;
+    uint32_t flags;
+    int32_t run;
+    uint32_t nColumns;
+    uint32_t nGroups;
+    uint32_t reserved;
+    uint64_t nRows;
+    uint64_t groupDirOffset;
+    uint64_t columnDirOffset;
+    uint64_t chunkDirOffset;
+};
+static_assert(sizeof(FileHeader) == 64, "header layout is part of the file format");
+
+struct GroupEntry {
+    char segment[8];
+    uint32_t event; // 1 = signal, 0 = background
+    uint32_t reserved;
+    uint64_t firstRow;
+    uint64_t nRows;
+};
+static_assert(sizeof(GroupEntry) == 32, "group layout is part of the file format");
+
+struct ColumnEntry {
+    char name[24];
+    char dtype[8];
+};
+static_assert(sizeof(ColumnEntry) == 32, "column layout is part of the file format");
+
+struct ChunkEntry {
+    uint64_t offset;
+    uint64_t storedBytes;
+    uint64_t rawBytes;
+};
+static_assert(sizeof(ChunkEntry) == 24, "chunk layout is part of the file format");
+
+// column order is fixed by this table; readers look columns up by name
+struct ColumnSpec {
+    const char* name;
+    const char* dtype;
+    size_t elemSize;
+};
+
+const ColumnSpec kColumns[] = {
+    {"time_us",  "<f8", 8},
+    {"pe",       "<f8", 8},
+    {"window",   "<i4", 4},
+    {"width_us", "<f8", 8},
+    {"pileup",   "|u1", 1},
+    {"nll",      "<f8", 8},
+};
+const uint32_t kNumColumns = sizeof(kColumns) / sizeof(kColumns[0]);
+
+// raw bytes of column c in table t
+const void* columnData(const PulseTable& t, uint32_t c) {
+    switch (c) {
+        case 0: return t.time.data();
+        case 1: return t.pe.data();
+        case 2: return t.window.data();
+        case 3: return t.width.data();
+        case 4: return t.pileup.data();
+        default: return t.nll.data();
+    }
+}
+
+// resize column c of table t to n rows and return its storage
+void* columnResize(PulseTable& t, uint32_t c, size_t n) {
+    switch (c) {
+        case 0: t.time.resize(n); return t.time.data();
+        case 1: t.pe.resize(n); return t.pe.data();
+        case 2: t.window.resize(n); return t.window.data();
+        case 3: t.width.resize(n); return t.width.data();
+        case 4: t.pileup.resize(n); return t.pileup.data();
+        default: t.nll.resize(n); return t.nll.data();
+    }
+}
+
+const char kTailMagic[8] = {'U', 'C', 'N', 'T', 'A', 'I', 'L', '1'};
+
+struct TailHeader {
+    char magic[8];
+    uint32_t nSegments;
+    uint32_t nBins;
+    double binWidth;
+    uint64_t reserved;
+};
+static_assert(sizeof(TailHeader) == 32, "tail header layout is part of the file format");
+
+void append(vector<char>& buf, const void* data, size_t n) {
+    const char* p = static_cast<const char*>(data);
+    buf.insert(buf.end(), p, p + n);
+}
+
+void padTo(vector<char>& buf, size_t align) {
+    buf.resize((buf.size() + align - 1) / align * align, 0);
+}
+
+} // namespace
+
+bool writePulseCSV(const RunPulses& pulses, const string& path) {
+    ofstream out(path);
+    if (!out.is_open()) {
+        cerr << "Error opening output file: " << path << endl;
+        return false;
+    }
+
+    out << "Segment, Time (us), PE, Event\n";
+
+    for (const auto& seg : pulses) {
+        // write signal pulses (Event=1)
+        for (size_t k = 0; k < seg.signal.size(); ++k) {
+            out << seg.label << ", "
+                << seg.signal.time[k]/1e6 << ", "
+                << seg.signal.pe[k] << ", "
+                << "1 \n";
+        }
+
+        // write background pulses (Event=0)
+        for (size_t k = 0; k < seg.background.size(); ++k) {
+            out << seg.label << ", "
+                << seg.background.time[k]/1e6 << ", "
+                << seg.background.pe[k] << ", "
+                << "0 \n";
+        }
+    }
+
+    out.close();
+    return true;
+}
+
+bool readPulseCSV(const string& path, RunPulses& pulses) {
+    ifstream in(path);
+    if (!in.is_open()) return false;
+
+    pulses.clear();
+    string line, label, cell;
+    getline(in, line); // header
+    while (getline(in, line)) {
+        if (line.empty()) continue;
+        stringstream row(line);
+        double time_s, pe;
+        int event;
+        getline(row, label, ',');
+        getline(row, cell, ','); time_s = stod(cell);
+        getline(row, cell, ','); pe = stod(cell);
+        getline(row, cell, ','); event = stoi(cell);
+
+        label.erase(0, label.find_first_not_of(' '));
+        if (pulses.empty() || pulses.back().label != label) pulses.push_back({label, {}, {}});
+        PulseTable& t = event ? pulses.back().signal : pulses.back().background;
+        t.push_back(time_s * 1e6, pe, 0, 0.0, false, 0.0); // window details are not in the CSV
+    }
+    return true;
+}
+
+vector<char> encodePulseBinary(const RunPulses& pulses, int run, bool compress) {
+    // row groups in the same order as the CSV: per segment, signal then background
+    vector<const PulseTable*> tables;
+    vector<GroupEntry> groups;
+    uint64_t nRows = 0;
+    for (const auto& seg : pulses) {
+        for (int event = 1; event >= 0; --event) {
+            const PulseTable& t = event ? seg.signal : seg.background;
+            GroupEntry g = {};
+            strncpy(g.segment, seg.label.c_str(), sizeof(g.segment) - 1);
+            g.event = event;
+            g.firstRow = nRows;
+            g.nRows = t.size();
+            nRows += t.size();
+            groups.push_back(g);
+            tables.push_back(&t);
+        }
+    }
+
+    FileHeader h = {};
+    memcpy(h.magic, kMagic, sizeof(kMagic));
+    h.version = kVersion;
+    h.flags = compress ? kFlagZlib : 0;
+    h.run = run;
+    h.nColumns = kNumColumns;
+    h.nGroups = static_cast<uint32_t>(groups.size());
+    h.nRows = nRows;
+    h.groupDirOffset = sizeof(FileHeader);
+    h.columnDirOffset = h.groupDirOffset + groups.size() * sizeof(GroupEntry);
+    h.chunkDirOffset = h.columnDirOffset + kNumColumns * sizeof(ColumnEntry);
+
+    vector<char> buf;
+    append(buf, &h, sizeof(h));
+    append(buf, groups.data(), groups.size() * sizeof(GroupEntry));
+    for (uint32_t c = 0; c < kNumColumns; ++c) {
+        ColumnEntry e = {};
+        strncpy(e.name, kColumns[c].name, sizeof(e.name) - 1);
+        strncpy(e.dtype, kColumns[c].dtype, sizeof(e.dtype) - 1);
+        append(buf, &e, sizeof(e));
+    }
+
+    // chunk index is filled in once the chunk offsets are known
+    vector<ChunkEntry> chunks(kNumColumns * groups.size());
+    append(buf, chunks.data(), chunks.size() * sizeof(ChunkEntry));
+
+    vector<Bytef> zbuf;
+    for (uint32_t c = 0; c < kNumColumns; ++c) {
+        padTo(buf, kAlign);
+        for (size_t g = 0; g < groups.size(); ++g) {
+            ChunkEntry& e = chunks[c * groups.size() + g];
+            const char* raw = static_cast<const char*>(columnData(*tables[g], c));
+            e.offset = buf.size();
+            e.rawBytes = groups[g].nRows * kColumns[c].elemSize;
+            if (compress && e.rawBytes > 0) {
+                uLongf zlen = compressBound(e.rawBytes);
+                zbuf.resize(zlen);
+                compress2(zbuf.data(), &zlen, reinterpret_cast<const Bytef*>(raw), e.rawBytes, 1);
+                e.storedBytes = zlen;
+                append(buf, zbuf.data(), zlen);
+            } else {
+                e.storedBytes = e.rawBytes;
+                append(buf, raw, e.rawBytes);
+            }
+        }
+    }
+
+    memcpy(buf.data() + h.chunkDirOffset, chunks.data(), chunks.size() * sizeof(ChunkEntry));
+    return buf;
+}
+
+bool decodePulseBinary(const char* data, size_t size, RunPulses& pulses, int& run) {
+    FileHeader h;
+    if (size < sizeof(h)) return false;
+    memcpy(&h, data, sizeof(h));
+    if (memcmp(h.magic, kMagic, sizeof(kMagic)) != 0 || h.version != kVersion) {
+        cerr << "Not a PulseAnalysis binary file (bad magic/version)" << endl;
+        return false;
+    }
+    if (h.chunkDirOffset + uint64_t(h.nColumns) * h.nGroups * sizeof(ChunkEntry) > size) return false;
+
+    vector<GroupEntry> groups(h.nGroups);
+    vector<ColumnEntry> columns(h.nColumns);
+    vector<ChunkEntry> chunks(size_t(h.nColumns) * h.nGroups);
+    memcpy(groups.data(), data + h.groupDirOffset, groups.size() * sizeof(GroupEntry));
+    memcpy(columns.data(), data + h.columnDirOffset, columns.size() * sizeof(ColumnEntry));
+    memcpy(chunks.data(), data + h.chunkDirOffset, chunks.size() * sizeof(ChunkEntry));
+
+    // one SegmentPulses per label, in file order (built before taking table pointers)
+    pulses.clear();
+    vector<size_t> segOf;
+    for (const auto& g : groups) {
+        string label(g.segment, strnlen(g.segment, sizeof(g.segment)));
+        if (pulses.empty() || pulses.back().label != label) {
+            pulses.push_back({label, {}, {}});
+        }
+        segOf.push_back(pulses.size() - 1);
+    }
+    vector<PulseTable*> tables;
+    for (size_t g = 0; g < groups.size(); ++g) {
+        tables.push_back(groups[g].event ? &pulses[segOf[g]].signal : &pulses[segOf[g]].background);
+    }
+
+    for (uint32_t fc = 0; fc < h.nColumns; ++fc) {
+        string name(columns[fc].name, strnlen(columns[fc].name, sizeof(columns[fc].name)));
+        uint32_t c = 0;
+        while (c < kNumColumns && name != kColumns[c].name) ++c;
+        if (c == kNumColumns) continue; // column from a newer writer
+
+        for (size_t g = 0; g < groups.size(); ++g) {
+            const ChunkEntry& e = chunks[fc * groups.size() + g];
+            if (e.offset + e.storedBytes > size || e.rawBytes != groups[g].nRows * kColumns[c].elemSize) {
+                cerr << "Corrupt chunk for column " << name << endl;
+                return false;
+            }
+            void* dst = columnResize(*tables[g], c, groups[g].nRows);
+            if (e.rawBytes == 0) continue;
+            if (h.flags & kFlagZlib) {
+                uLongf rawLen = e.rawBytes;
+                if (uncompress(static_cast<Bytef*>(dst), &rawLen,
+                               reinterpret_cast<const Bytef*>(data + e.offset), e.storedBytes) != Z_OK ||
+                    rawLen != e.rawBytes) {
+                    cerr << "Failed to decompress column " << name << endl;
+                    return false;
+                }
+            } else {
+                memcpy(dst, data + e.offset, e.rawBytes);
+            }
+        }
+    }
+
+    run = h.run;
+    return true;
+}
+
+vector<char> encodeTailBinary(const vector<vector<double>>& tails, const vector<string>& segment_labels,
+                              double binWidth)
+{
+    TailHeader h = {};
+    memcpy(h.magic, kTailMagic, sizeof(kTailMagic));
+    h.nSegments = static_cast<uint32_t>(tails.size());
+    h.nBins = tails.empty() ? 0 : static_cast<uint32_t>(tails[0].size());
+    h.binWidth = binWidth;
+
+    vector<char> buf;
+    append(buf, &h, sizeof(h));
+    for (size_t seg = 0; seg < tails.size(); ++seg) {
+        char label[8] = {};
+        if (seg < segment_labels.size()) strncpy(label, segment_labels[seg].c_str(), sizeof(label) - 1);
+        append(buf, label, sizeof(label));
+    }
+    for (const auto& tail : tails) append(buf, tail.data(), h.nBins * sizeof(double));
+    return buf;
+}
+
+bool decodeTailBinary(const char* data, size_t size, vector<vector<double>>& tails,
+                      vector<string>& segment_labels, double& binWidth)
+{
+    TailHeader h;
+    if (size < sizeof(h)) return false;
+    memcpy(&h, data, sizeof(h));
+    if (memcmp(h.magic, kTailMagic, sizeof(kTailMagic)) != 0) return false;
+    size_t need = sizeof(h) + h.nSegments * (8 + size_t(h.nBins) * sizeof(double));
+    if (size < need) return false;
+
+    const char* p = data + sizeof(h);
+    segment_labels.clear();
+    for (uint32_t seg = 0; seg < h.nSegments; ++seg, p += 8) {
+        segment_labels.emplace_back(p, strnlen(p, 8));
+    }
+    tails.assign(h.nSegments, vector<double>(h.nBins));
+    for (auto& tail : tails) {
+        memcpy(tail.data(), p, h.nBins * sizeof(double));
+        p += h.nBins * sizeof(double);
+    }
+    binWidth = h.binWidth;
+    return true;
+}
+
+bool writePulseBinary(const RunPulses& pulses, int run, const string& path, bool compress) {
+    ofstream out(path, ios::binary);
+    if (!out.is_open()) {
+        cerr << "Error opening output file: " << path << endl;
+        return false;
+    }
+    vector<char> buf = encodePulseBinary(pulses, run, compress);
+    out.write(buf.data(), buf.size());
+    return static_cast<bool>(out);
+}
+
+bool readPulseBinary(const string& path, RunPulses& pulses, int& run) {
+    ifstream in(path, ios::binary | ios::ate);
+    if (!in.is_open()) return false;
+    vector<char> buf(static_cast<size_t>(in.tellg()));
+    in.seekg(0);
+    if (!in.read(buf.data(), buf.size())) return false;
+    return decodePulseBinary(buf.data(), buf.size(), pulses, run);
+}
@@ -1,23 +1,25 @@
 #include "Pulse_Tail.h"
 #include "File_Loader.h"
 #include "Pulse_Fitting.h"
+#include "Pulse_Output.h"
+#include "Result_Store.h"
+#include "Trace.h"
+#include "Stage_Timer.h"
 #include <json.hpp>
+#include <memory>
 #include <fstream>
 #include <iostream>
-#include <TCanvas.h>
-#include <TH1D.h>
-#include <TLegend.h>
-#include <TStyle.h>
 
 using json = nlohmann::json;
 
 // Accumulate the histogram for the tail response of PMTs
 std::vector<double> accumulateTailHistogram(
-    const std::vector<std::tuple<double, double, int, double, bool>>& pulses,
+    const PulseTable& pulses,
     const EventList& run_data,
     double binWidth, 
     double maxTime)
 {
+    ScopedStage timer(Stage::TailAccumulation);
     int nBins = static_cast<int>(std::ceil(maxTime / binWidth));
     std::vector<double> xCenters(nBins), hist(nBins, 0.0);
 
@@ -25,10 +27,10 @@ std::vector<double> accumulateTailHistogram(
         xCenters[i] = i * binWidth;
     }
 
-    for (const auto& pulse : pulses) {
-        if (std::get<4>(pulse)) continue; // skip windows with pileup
+    for (size_t p = 0; p < pulses.size(); ++p) {
+        if (pulses.pileup[p]) continue; // skip windows with pileup
 
-        double pulse_time = std::get<0>(pulse); // pulse time (us)
+        double pulse_time = pulses.time[p]; // pulse time (us)
 
         for (const auto& e : run_data) {
             double t = e.realtime * 1e6; // PE time (us)
@@ -43,8 +45,9 @@ std::vector<double> accumulateTailHistogram(
     return hist;
 }
 
-// Save the tail as a CSV file
-void PlotTail(const std::vector<std::vector<double>>& tails, const std::vector<std::string>& segment_labels, const std::string& output_path) {
+// Save the tail as a CSV file (rendered later by Plot_Tail)
+void SaveTail(const std::vector<std::vector<double>>& tails, const std::vector<std::string>& segment_labels,
+              const std::string& output_path, double binWidth) {
     std::ofstream out(output_path);
     if (!out.is_open()) {
         std::cerr << "Failed to open output file: " << output_path << std::endl;
@@ -58,7 +61,6 @@ void PlotTail(const std::vector<std::vector<double>>& tails, const std::vector<s
     out << "\n";
 
     int nBins = tails[0].size();
-    double binWidth = 0.1; // bin width (us) must match accumulateTailHistogram call
 
     for (int i = 0; i < nBins; ++i) {
         out << i * binWidth;
@@ -85,11 +87,29 @@ int main(int argc, char **argv) {
         std::cout << "Start run: "     << cfg.start_run     << "\n";
         std::cout << "End run: "       << cfg.end_run       << "\n";
         std::cout << "Good runs loaded: " << cfg.good_runs_set.size() << " entries\n";
+        std::cout << "Result store: "  << (cfg.result_store.empty() ? "(per-run files)" : cfg.result_store) << "\n";
 		std::cout << "====================================" << std::endl;
 	} catch (const std::exception& e) {
 		cerr << "Error starting program: " << e.what() << endl;
 		return 1;
 	}
+    if (cfg.split_window_bins > 0 && cfg.split_window_bins < Pulse_Fitting::minSplitBins()) { // fitters use the default bins
+        cerr << "Error: split_window_bins " << cfg.split_window_bins << " is below the minimum "
+             << Pulse_Fitting::minSplitBins() << " (twice the part overlap)" << endl;
+        return 1;
+    }
+
+    if (cfg.perf_counters) enableStageAccounting(true, false, cerr); // per-stage counters, printed at the end
+
+    unique_ptr<Result_Store> store;
+    if (!cfg.result_store.empty()) {
+        try {
+            store = make_unique<Result_Store>(cfg.result_store);
+        } catch (const std::exception& e) {
+            cerr << "Error opening result store: " << e.what() << endl;
+            return 1;
+        }
+    }
 
 	std::string data_folder   = ensureTrailingSlash(cfg.data_folder);
     std::string output_folder = ensureTrailingSlash(cfg.output_folder);
@@ -100,7 +120,10 @@ int main(int argc, char **argv) {
 	const std::set<std::string>& good_runs = cfg.good_runs_set;
 
     std::vector<std::string> segment_labels = {"12", "34", "56", "78"};
-    std::vector<std::vector<double>> pulse_tails(4, vector<double>(750, 0.0)); // 75us @ 0.1us/bin
+    const double tailBinWidth = 0.1; // us
+    const double tailMaxTime = 75.0; // us
+    const int tailBins = static_cast<int>(std::ceil(tailMaxTime / tailBinWidth));
+    std::vector<std::vector<double>> pulse_tails(4, vector<double>(tailBins, 0.0)); // 75us @ 0.1us/bin
     int is_valid = 0;
 
     for (int z = startrun; z < endrun; z++) {
@@ -112,7 +135,7 @@ int main(int argc, char **argv) {
 		}
 
         if (params.contains(run) && params[run]["run_type"] == "production") {
-            std::vector<std::vector<double>> pulse_tails_single(4, vector<double>(750, 0.0)); // per-run accumulation
+            std::vector<std::vector<double>> pulse_tails_single(4, vector<double>(tailBins, 0.0)); // per-run accumulation
             vector<EventList> run_data = processfile(data_folder, run);
             if (run_data.empty()) {
                 cerr << "No data found for run " << run << ". Skipping." << endl;
@@ -128,71 +151,43 @@ int main(int argc, char **argv) {
                 Pulse_Fitting fitter(run_data[seg]);
                 fitter.setWindow(start * 1e6, stop * 1e6);
                 fitter.setBackgroundWindow(bg_start * 1e6);
+                fitter.setKernelTolerance(cfg.kernel_tolerance);
+                fitter.setRecursiveKernel(cfg.recursive_kernel);
+                fitter.setIncrementalLikelihood(cfg.incremental_likelihood);
+                fitter.setWindowTriage(cfg.window_triage);
+                fitter.setWindowSplitting(cfg.split_window_bins);
                 fitter.analyze();
 
-                auto signalPulses = fitter.getSignalPulses();
-                auto tail = accumulateTailHistogram(signalPulses, run_data[seg], 0.1, 75.0); // 0.1us bins, 75us range
+                const PulseTable& signalPulses = fitter.getSignalPulses();
+                auto tail = accumulateTailHistogram(signalPulses, run_data[seg], tailBinWidth, tailMaxTime);
                 for (size_t b = 0; b < tail.size(); ++b) {
                     pulse_tails_single[seg][b] += tail[b];
                     pulse_tails[seg][b] += tail[b];
                 }
             }
-            PlotTail(pulse_tails_single, segment_labels, output_folder + "/tail/summed_tail_response_" + run + ".csv");
-            // write per-run CSV of cumulative tails (all segments)
+            // write per-run tails (all segments): store record or CSV
+            if (store) {
+                store->commit(RecordKind::Tail, z, encodeTailBinary(pulse_tails_single, segment_labels, tailBinWidth));
+            } else {
+                SaveTail(pulse_tails_single, segment_labels, output_folder + "tail/summed_tail_response_" + run + ".csv", tailBinWidth);
+            }
             run_data.clear();
             pulse_tails_single.clear();
             is_valid++;
         }
     }    
 
-    if (is_valid == 0) return 0;
-
-    TCanvas* c1 = new TCanvas("c1", "Tail Histograms", 1200, 600);
-    c1->Divide(2, 1);
-
-    gStyle->SetOptStat(0);
-    std::vector<int> colors = {kRed, kBlue, kGreen+2, kMagenta};
-    double binWidth = 0.1;
-    int nBins = pulse_tails[0].size();
-
-    std::vector<TH1D*> hists;
-    hists.reserve(pulse_tails.size());
-    for (size_t seg = 0; seg < pulse_tails.size(); ++seg) {
-        std::string name  = "h" + segment_labels[seg];
-        std::string title = "Segment " + segment_labels[seg];
-        TH1D* h = new TH1D(name.c_str(), title.c_str(), nBins, 0, nBins * binWidth);
-        for (int i = 0; i < nBins; ++i) h->SetBinContent(i+1, pulse_tails[seg][i]);
-        h->SetLineColor(colors[seg % colors.size()]);
-        h->SetLineWidth(2);
-        h->GetXaxis()->SetTitle("Time after pulse (#mu s)");
-        h->GetYaxis()->SetTitle("Counts");
-        hists.push_back(h);
-    }
-
-    // ---- Pad 1: linear ----
-    c1->cd(1);
-    gPad->SetGrid();
-    TLegend* leg1 = new TLegend(0.65, 0.70, 0.88, 0.88);
-    for (size_t i = 0; i < hists.size(); ++i) {
-        if (i == 0) hists[i]->SetTitle("Summed Tail Response (linear)");
-        hists[i]->Draw(i == 0 ? "HIST" : "HIST SAME");
-        leg1->AddEntry(hists[i], ("Segment " + segment_labels[i]).c_str(), "l");
+    if (stageTotals_.perf) {
+        cout << "Hardware counters, runs " << startrun << "-" << endrun << ":" << endl;
+        printStageCounters(cout, StageSnapshot{});
     }
-    leg1->Draw();
-
-    // ---- Pad 2: log ----
-    c1->cd(2);
-    gPad->SetGrid();
-    gPad->SetLogy();  // log-scale y-axis
-    TLegend* leg2 = new TLegend(0.65, 0.70, 0.88, 0.88);
-    for (size_t i = 0; i < hists.size(); ++i) {
-        if (i == 0) hists[i]->SetTitle("Summed Tail Response (log y)");
-        hists[i]->Draw(i == 0 ? "HIST" : "HIST SAME");
-        leg2->AddEntry(hists[i], ("Segment " + segment_labels[i]).c_str(), "l");
-    }
-    leg2->Draw();
+    TRACE_WRITE(output_folder + "tail/trace_" + std::to_string(startrun) + "_" + std::to_string(endrun) + ".json");
+    if (is_valid == 0) return 0;
 
-    c1->SaveAs((output_folder + "/graphs/summed_tail_response" +
-                std::to_string(startrun) + "_" + std::to_string(endrun) + ".png").c_str());
+    // summed tails over the whole run range; render with `Plot_Tail` (no graphics in this job)
+    std::string summed_path = output_folder + "tail/summed_tail_response_" +
+                              std::to_string(startrun) + "_" + std::to_string(endrun) + ".csv";
+    SaveTail(pulse_tails, segment_labels, summed_path, tailBinWidth);
+    cout << "Summed tail written to " << summed_path << " (plot with ./Plot_Tail)" << endl;
     return 0;
-}
\ No newline at end of file
+}
@@ -0,0 +1,261 @@
+#include "Result_Store.h"
+#include <stdexcept>
+#include <iostream>
+#include <cstring>
+#include <cerrno>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/stat.h>
+#include <zlib.h>
+
+using namespace std;
+
+namespace {
+
+const char kStoreMagic[8] = {'U', 'C', 'N', 'S', 'T', 'O', 'R', '1'};
+const uint32_t kStoreVersion = 1;
+const uint32_t kRecordMagic = 0x31434552; // "REC1"
+const uint32_t kCommitMagic = 0x31544d43; // "CMT1"
+
+struct StoreHeader {
+    char magic[8];
+    uint32_t version;
+    uint32_t reserved;
+    uint64_t reserved2[2];
+};
+
+struct RecordHeader {
+    uint32_t magic;
+    uint32_t kind;
+    int32_t run;
+    uint32_t crc; // crc32 of the payload
+    uint64_t payloadBytes;
+    uint64_t reserved;
+};
+
+struct CommitTrailer {
+    uint32_t magic;
+    uint32_t kind;
+    int32_t run;
+    uint32_t crc; // same as the record header; guards against a stale trailer
+    uint64_t recordOffset;
+    uint64_t prevTrailer; // 0 for the first commit
+};
+
+static_assert(sizeof(StoreHeader) == 32, "store header layout is part of the file format");
+static_assert(sizeof(RecordHeader) == 32, "record header layout is part of the file format");
+static_assert(sizeof(CommitTrailer) == 32, "commit trailer layout is part of the file format");
+
+bool preadAll(int fd, void* buf, size_t n, uint64_t offset) {
+    char* p = static_cast<char*>(buf);
+    while (n > 0) {
+        ssize_t r = pread(fd, p, n, offset);
+        if (r < 0 && errno == EINTR) continue;
+        if (r <= 0) return false;
+        p += r; n -= r; offset += r;
+    }
+    return true;
+}
+
+bool pwriteAll(int fd, const void* buf, size_t n, uint64_t offset) {
+    const char* p = static_cast<const char*>(buf);
+    while (n > 0) {
+        ssize_t r = pwrite(fd, p, n, offset);
+        if (r < 0 && errno == EINTR) continue;
+        if (r <= 0) return false;
+        p += r; n -= r; offset += r;
+    }
+    return true;
+}
+
+uint64_t fileSize(int fd) {
+    struct stat st;
+    if (fstat(fd, &st) != 0) throw runtime_error(string("fstat failed: ") + strerror(errno));
+    return static_cast<uint64_t>(st.st_size);
+}
+
+// trailer at 'pos' is a complete commit whose record ends exactly at 'pos'
+bool readCommit(int fd, uint64_t pos, CommitTrailer& t) {
+    if (pos < sizeof(StoreHeader) + sizeof(RecordHeader)) return false;
+    if (!preadAll(fd, &t, sizeof(t), pos) || t.magic != kCommitMagic) return false;
+    RecordHeader r;
+    if (t.recordOffset < sizeof(StoreHeader) || !preadAll(fd, &r, sizeof(r), t.recordOffset)) return false;
+    return r.magic == kRecordMagic && r.kind == t.kind && r.run == t.run && r.crc == t.crc &&
+           t.recordOffset + sizeof(RecordHeader) + r.payloadBytes == pos;
+}
+
+} // namespace
+
+Result_Store::Result_Store(const string& path)
+    : path_(path), fd_(-1), lastTrailer_(0)
+{
+    fd_ = open(path.c_str(), O_RDWR | O_CREAT, 0644);
+    if (fd_ < 0) throw runtime_error("Cannot open result store " + path + ": " + strerror(errno));
+
+    lock_guard<mutex> guard(mutex_);
+    lockFile(true);
+    if (fileSize(fd_) == 0) {
+        StoreHeader h = {};
+        memcpy(h.magic, kStoreMagic, sizeof(kStoreMagic));
+        h.version = kStoreVersion;
+        pwriteAll(fd_, &h, sizeof(h), 0);
+        fdatasync(fd_);
+    } else {
+        StoreHeader h;
+        if (!preadAll(fd_, &h, sizeof(h), 0) || memcmp(h.magic, kStoreMagic, sizeof(kStoreMagic)) != 0) {
+            unlockFile();
+            close(fd_);
+            throw runtime_error("Not a result store: " + path);
+        }
+    }
+    updateIndex();
+    unlockFile();
+}
+
+Result_Store::~Result_Store() {
+    if (fd_ >= 0) close(fd_);
+}
+
+void Result_Store::lockFile(bool exclusive) {
+    struct flock fl = {};
+    fl.l_type = exclusive ? F_WRLCK : F_RDLCK;
+    fl.l_whence = SEEK_SET; // l_start = l_len = 0: whole file
+    while (fcntl(fd_, F_SETLKW, &fl) != 0) {
+        if (errno != EINTR) throw runtime_error(string("Result store lock failed: ") + strerror(errno));
+    }
+}
+
+void Result_Store::unlockFile() {
+    struct flock fl = {};
+    fl.l_type = F_UNLCK;
+    fl.l_whence = SEEK_SET;
+    fcntl(fd_, F_SETLK, &fl);
+}
+
+uint64_t Result_Store::validEnd(uint64_t size, uint64_t& lastTrailer) {
+    // fast path: the file ends in a complete commit
+    CommitTrailer t;
+    if (size >= sizeof(StoreHeader) + sizeof(CommitTrailer) && readCommit(fd_, size - sizeof(t), t)) {
+        lastTrailer = size - sizeof(t);
+        return size;
+    }
+
+    // torn tail (interrupted writer): walk records forward to the last complete commit
+    lastTrailer = 0;
+    uint64_t off = sizeof(StoreHeader);
+    RecordHeader r;
+    while (off + sizeof(r) <= size && preadAll(fd_, &r, sizeof(r), off) && r.magic == kRecordMagic) {
+        uint64_t trailerPos = off + sizeof(r) + r.payloadBytes;
+        if (trailerPos + sizeof(t) > size || !readCommit(fd_, trailerPos, t)) break;
+        lastTrailer = trailerPos;
+        off = trailerPos + sizeof(t);
+    }
+    return off;
+}
+
+void Result_Store::updateIndex() {
+    uint64_t tail = 0;
+    validEnd(fileSize(fd_), tail);
+    if (tail == lastTrailer_) return;
+
+    // walk the trailer chain back to the last trailer already indexed; newest record wins
+    map<pair<uint32_t, int>, Entry> fresh;
+    for (uint64_t pos = tail; pos != 0 && pos != lastTrailer_; ) {
+        CommitTrailer t;
+        if (!readCommit(fd_, pos, t)) {
+            cerr << "Result store " << path_ << ": broken commit chain at offset " << pos << endl;
+            break;
+        }
+        auto key = make_pair(t.kind, static_cast<int>(t.run));
+        if (fresh.find(key) == fresh.end()) {
+            fresh[key] = {t.recordOffset, pos - t.recordOffset - sizeof(RecordHeader), t.crc};
+        }
+        pos = t.prevTrailer;
+    }
+    for (const auto& kv : fresh) index_[kv.first] = kv.second;
+
+    lastTrailer_ = tail;
+}
+
+bool Result_Store::commit(RecordKind kind, int run, const vector<char>& payload) {
+    lock_guard<mutex> guard(mutex_);
+    lockFile(true);
+
+    uint64_t size = fileSize(fd_);
+    uint64_t prev = 0;
+    uint64_t end = validEnd(size, prev);
+    if (end < size && ftruncate(fd_, end) != 0) { // drop a torn append left by a crashed writer
+        unlockFile();
+        cerr << "Result store " << path_ << ": cannot truncate torn tail" << endl;
+        return false;
+    }
+
+    RecordHeader r = {};
+    r.magic = kRecordMagic;
+    r.kind = static_cast<uint32_t>(kind);
+    r.run = run;
+    r.crc = crc32(0L, reinterpret_cast<const Bytef*>(payload.data()), payload.size());
+    r.payloadBytes = payload.size();
+
+    CommitTrailer t = {};
+    t.magic = kCommitMagic;
+    t.kind = r.kind;
+    t.run = run;
+    t.crc = r.crc;
+    t.recordOffset = end;
+    t.prevTrailer = prev;
+
+    // payload is durable before the trailer makes it visible
+    uint64_t trailerPos = end + sizeof(r) + payload.size();
+    bool ok = pwriteAll(fd_, &r, sizeof(r), end) &&
+              pwriteAll(fd_, payload.data(), payload.size(), end + sizeof(r)) &&
+              fdatasync(fd_) == 0 &&
+              pwriteAll(fd_, &t, sizeof(t), trailerPos) &&
+              fdatasync(fd_) == 0;
+
+    if (ok) updateIndex();
+    unlockFile();
+
+    if (!ok) cerr << "Result store " << path_ << ": commit of run " << run << " failed: " << strerror(errno) << endl;
+    return ok;
+}
+
+bool Result_Store::fetch(RecordKind kind, int run, vector<char>& payload) {
+    Entry e;
+    {
+        lock_guard<mutex> guard(mutex_);
+        auto it = index_.find(make_pair(static_cast<uint32_t>(kind), run));
+        if (it == index_.end()) return false;
+        e = it->second;
+    }
+
+    // committed records are immutable: no file lock needed
+    payload.resize(e.payloadBytes);
+    if (!preadAll(fd_, payload.data(), payload.size(), e.offset + sizeof(RecordHeader))) return false;
+    if (crc32(0L, reinterpret_cast<const Bytef*>(payload.data()), payload.size()) != e.crc) {
+        cerr << "Result store " << path_ << ": checksum mismatch for run " << run << endl;
+        return false;
+    }
+    return true;
+}
+
+bool Result_Store::contains(RecordKind kind, int run) {
+    lock_guard<mutex> guard(mutex_);
+    return index_.count(make_pair(static_cast<uint32_t>(kind), run)) > 0;
+}
+
+vector<int> Result_Store::runs(RecordKind kind) {
+    lock_guard<mutex> guard(mutex_);
+    vector<int> out;
+    for (const auto& kv : index_) {
+        if (kv.first.first == static_cast<uint32_t>(kind)) out.push_back(kv.first.second);
+    }
+    return out; // map order: already sorted by run
+}
+
+void Result_Store::refresh() {
+    lock_guard<mutex> guard(mutex_);
+    lockFile(false);
+    updateIndex();
+    unlockFile();
+}
@@ -0,0 +1,94 @@
+#include "Synthetic_Events.h"
+#include "Pulse_Fitting.h" // pdfParams_
+#include <algorithm>
+#include <fstream>
+#include <iomanip>
+#include <iostream>
+
+using namespace std;
+
+namespace {
+
+const int kSegmentChannels[4][2] = {{1, 2}, {3, 4}, {11, 12}, {13, 14}}; // as routed by processfile
+const double kTickSeconds = 1e-9; // synthetic 'time' ticks; the analysis only reads realtime
+
+event makeEvent(double realtime, int channel) {
+    event e = {};
+    e.channel = channel;
+    e.time = static_cast<ULong64_t>(realtime / kTickSeconds);
+    e.realtime = realtime;
+    return e;
+}
+
+} // namespace
+
+double samplePEDelay(mt19937_64& rng) {
+    const PDFParams& p = pdfParams_;
+    double u = uniform_real_distribution<double>(0.0, p.ratio1 + p.ratio2 + p.ratio3)(rng);
+    double scale = u < p.ratio1 ? p.scale1 : u < p.ratio1 + p.ratio2 ? p.scale2 : p.scale3;
+    return max(p.loc + exponential_distribution<double>(1.0 / scale)(rng), 0.0);
+}
+
+vector<EventList> generateSyntheticRun(const SyntheticParams& p, vector<vector<TruthPulse>>* truth) {
+    vector<EventList> result;
+    if (truth) truth->assign(4, {});
+
+    for (int seg = 0; seg < 4; ++seg) {
+        seed_seq seq{p.seed, static_cast<uint64_t>(seg)}; // independent, reproducible stream per segment
+        mt19937_64 rng(seq);
+        uniform_int_distribution<int> pickChannel(0, 1);
+        normal_distribution<double> yield(p.peMean, p.peSigma);
+        vector<event> events;
+        vector<TruthPulse> neutrons;
+
+        // neutron arrivals: Poisson process, some followed by a pileup partner
+        vector<double> arrivals;
+        if (p.neutronRate > 0) {
+            exponential_distribution<double> gap(p.neutronRate);
+            uniform_real_distribution<double> unit(0.0, 1.0);
+            for (double t = p.neutronStart + gap(rng); t < p.neutronStop; t += gap(rng)) {
+                arrivals.push_back(t);
+                if (unit(rng) < p.pileupFraction) arrivals.push_back(t + unit(rng) * p.pileupWindowUs * 1e-6);
+            }
+        }
+        for (double t : arrivals) {
+            int nPE = poisson_distribution<int>(max(yield(rng), 0.1))(rng);
+            if (nPE == 0) continue;
+            neutrons.push_back({t, nPE});
+            for (int k = 0; k < nPE; ++k) {
+                events.push_back(makeEvent(t + samplePEDelay(rng) * 1e-6, kSegmentChannels[seg][pickChannel(rng)]));
+            }
+        }
+
+        // uncorrelated single-PE background over the whole run
+        if (p.backgroundRate > 0) {
+            exponential_distribution<double> gap(p.backgroundRate);
+            for (double t = gap(rng); t < p.duration; t += gap(rng)) {
+                events.push_back(makeEvent(t, kSegmentChannels[seg][pickChannel(rng)]));
+            }
+        }
+
+        sort(events.begin(), events.end(), [](const event& a, const event& b) { return a.realtime < b.realtime; });
+        result.emplace_back(events.begin(), events.end());
+        if (truth) {
+            sort(neutrons.begin(), neutrons.end(), [](const TruthPulse& a, const TruthPulse& b) { return a.time < b.time; });
+            (*truth)[seg] = move(neutrons);
+        }
+    }
+    return result;
+}
+
+bool writeTruthCSV(const vector<vector<TruthPulse>>& truth, const vector<string>& segment_labels, const string& path) {
+    ofstream out(path);
+    if (!out.is_open()) {
+        cerr << "Error opening truth file: " << path << endl;
+        return false;
+    }
+    out << "Segment,Time (s),PE\n" << setprecision(15);
+    for (size_t seg = 0; seg < truth.size() && seg < segment_labels.size(); ++seg) {
+        for (const auto& n : truth[seg]) {
+            out << segment_labels[seg] << "," << n.time << "," << n.pe << "\n";
+        }
+    }
+    return true;
+}
@@ -0,0 +1,106 @@
+#include "Window_Corpus.h"
+#include <algorithm>
+#include <cstring>
+#include <iostream>
+#include <stdexcept>
+#include <sys/stat.h>
+
+using namespace std;
+
+namespace {
+
+const char kCorpusMagic[8] = {'U', 'C', 'N', 'W', 'C', 'O', 'R', '1'};
+const uint32_t kCorpusVersion = 1;
+
+struct CorpusHeader {
+    char magic[8];
+    uint32_t version;
+    uint32_t reserved;
+};
+
+struct WindowRecord {
+    int32_t run;
+    char segment[4];
+    uint8_t signal;
+    uint8_t pad[3];
+    uint32_t nBins;
+    double binWidth;
+    double startTime;
+};
+
+static_assert(sizeof(CorpusHeader) == 16, "corpus header layout is part of the file format");
+static_assert(sizeof(WindowRecord) == 32, "window record layout is part of the file format");
+
+bool gzReadAll(gzFile f, void* buf, size_t n) {
+    return n == 0 || gzread(f, buf, static_cast<unsigned>(n)) == static_cast<int>(n);
+}
+
+} // namespace
+
+Window_Corpus::Window_Corpus(const string& path) : file_(nullptr), nWritten_(0) {
+    struct stat st;
+    bool fresh = stat(path.c_str(), &st) != 0 || st.st_size == 0;
+    file_ = gzopen(path.c_str(), "ab1"); // fast compression: this runs inside the fitting loop
+    if (!file_) throw runtime_error("Cannot open window corpus " + path);
+    if (fresh) {
+        CorpusHeader h = {};
+        memcpy(h.magic, kCorpusMagic, sizeof(kCorpusMagic));
+        h.version = kCorpusVersion;
+        gzwrite(file_, &h, sizeof(h));
+    }
+}
+
+Window_Corpus::~Window_Corpus() {
+    if (file_) gzclose(file_);
+}
+
+void Window_Corpus::append(int run, const string& segment, bool signal, double binWidth,
+                           double startTime, const vector<int>& hist)
+{
+    WindowRecord r = {};
+    r.run = run;
+    memcpy(r.segment, segment.data(), min(segment.size(), sizeof(r.segment))); // fixed field, not NUL-terminated
+    r.signal = signal ? 1 : 0;
+    r.nBins = static_cast<uint32_t>(hist.size());
+    r.binWidth = binWidth;
+    r.startTime = startTime;
+
+    lock_guard<mutex> guard(mutex_);
+    gzwrite(file_, &r, sizeof(r));
+    if (!hist.empty()) gzwrite(file_, hist.data(), static_cast<unsigned>(hist.size() * sizeof(int))); // int32 counts
+    ++nWritten_;
+}
+
+bool readWindowCorpus(const string& path, vector<CorpusWindow>& windows) {
+    gzFile f = gzopen(path.c_str(), "rb");
+    if (!f) {
+        cerr << "Error opening window corpus: " << path << endl;
+        return false;
+    }
+
+    CorpusHeader h;
+    if (!gzReadAll(f, &h, sizeof(h)) || memcmp(h.magic, kCorpusMagic, sizeof(kCorpusMagic)) != 0) {
+        cerr << "Not a window corpus: " << path << endl;
+        gzclose(f);
+        return false;
+    }
+
+    windows.clear();
+    WindowRecord r;
+    while (gzReadAll(f, &r, sizeof(r))) {
+        CorpusWindow w;
+        w.run = r.run;
+        w.segment = string(r.segment, strnlen(r.segment, sizeof(r.segment)));
+        w.signal = r.signal != 0;
+        w.binWidth = r.binWidth;
+        w.startTime = r.startTime;
+        w.hist.resize(r.nBins);
+        if (!gzReadAll(f, w.hist.data(), w.hist.size() * sizeof(int))) {
+            cerr << "Window corpus " << path << ": truncated record after " << windows.size() << " windows" << endl;
+            break;
+        }
+        windows.push_back(move(w));
+    }
+    gzclose(f);
+    return true;
+}